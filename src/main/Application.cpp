@@ -4,9 +4,14 @@
 #include "Application.h"
 
 #include "MainWindow.h"
+#include "CacheManager.h"
 #include "EndpointConfigModel.h"
+#include "HttpCassette.h"
+#include "MlClientTools.h"
 #include "PasswordStore.h"
+#include "Tools.h"
 #include "UserSettings.h"
+#include <QCommandLineParser>
 #include <QLoggingCategory>
 #include <QThreadPool>
 
@@ -51,6 +56,9 @@ Application::~Application()
 
 bool Application::initialize()
 {
+    if (!parseCommandLine())
+        return false;
+
     { // set some default settings
         UserSettings s;
         if (s.value(CfgLastAccessedDirectory).isNull())
@@ -69,9 +77,58 @@ bool Application::initialize()
 
     passwordStore_.reset(new PasswordStore{});
 
+    cacheManager_.reset(new CacheManager{});
+    cacheManager_->update();
+
     mainWindow_.reset(new MainWindow());
     mainWindow_->initialize();
 
+    connect(mainWindow_.get(), &MainWindow::endpointConfigChanged, cacheManager_.get(), &CacheManager::update);
+
+    // Sizes tuned by loads which did not end before, e.g. the interactive ones
+    connect(this, &QCoreApplication::aboutToQuit, this, &storeTunedChunkSizes);
+
+    return true;
+}
+
+bool Application::parseCommandLine()
+{
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOptions({
+        {QStringLiteral("record"),
+         tr("Record all HTTP exchanges with the Mainzelliste into cassette <file>."),
+         QStringLiteral("file")},
+        {QStringLiteral("replay"),
+         tr("Answer all requests from cassette <file> instead of the Mainzelliste."),
+         QStringLiteral("file")},
+        {QStringLiteral("replay-speed"),
+         tr("Time scale of the replayed response durations, 0 replays instantly (default: 1)."),
+         QStringLiteral("factor"), QStringLiteral("1")},
+    });
+    parser.process(*this);
+
+    if (parser.isSet(QStringLiteral("replay")))
+    {
+        cassette_.reset(new HttpCassette{});
+        if (!cassette_->load(parser.value(QStringLiteral("replay"))))
+        {
+            qCCritical(MLR_LOG_CAT) << "Failed to load cassette:" << cassette_->errorString();
+            return false;
+        }
+        replaying_ = true;
+        replayTimeScale_ = parser.value(QStringLiteral("replay-speed")).toDouble();
+    }
+    else if (parser.isSet(QStringLiteral("record")))
+    {
+        cassette_.reset(new HttpCassette{});
+        if (!cassette_->startRecording(parser.value(QStringLiteral("record"))))
+        {
+            qCCritical(MLR_LOG_CAT) << "Failed to create cassette:" << cassette_->errorString();
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -5,8 +5,10 @@
 
 #include <QApplication>
 
+class CacheManager;
 class MainWindow;
 class EndpointConfigModel;
+class HttpCassette;
 class PasswordStore;
 
 class Application : public QApplication
@@ -21,14 +23,27 @@ public:
 
     EndpointConfigModel* endpointConfigModel() const { return endpointConfigModel_.get(); }
     PasswordStore* passwordStore() const { return passwordStore_.get(); }
+    CacheManager* cacheManager() const { return cacheManager_.get(); }
     MainWindow* mainWindow() const { return mainWindow_.get(); }
 
+    // Set when started with --record or --replay
+    HttpCassette* cassette() const { return cassette_.get(); }
+    bool isReplaying() const { return replaying_; }
+    double replayTimeScale() const { return replayTimeScale_; }
+
     void runJob(const std::function<void()>& runnable);
 
+private:
+    bool parseCommandLine();
+
 private:
     QScopedPointer<EndpointConfigModel> endpointConfigModel_;
     QScopedPointer<PasswordStore> passwordStore_;
+    QScopedPointer<CacheManager> cacheManager_;
     QScopedPointer<MainWindow> mainWindow_;
+    QScopedPointer<HttpCassette> cassette_;
+    bool replaying_{};
+    double replayTimeScale_{1.0};
     QAtomicInt runningJobs_{};
 
     Q_DISABLE_COPY_MOVE(Application)
@@ -0,0 +1,222 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "CacheManager.h"
+
+#include "Application.h"
+#include "EndpointConfigModel.h"
+#include "MlClient.h"
+#include "MlDiskCache.h"
+#include "PasswordStore.h"
+#include "Tools.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QStandardPaths>
+
+namespace {
+
+const auto KeyNamespace = QStringLiteral("record-cache-key");
+
+constexpr qint64 MsPerHour = 60 * 60 * 1000;
+// Interrupted bulk loads can be resumed for this long
+constexpr qint64 JournalTtlMs = 7 * 24 * MsPerHour;
+
+} // namespace
+
+CacheManager::CacheManager(QObject* parent) :
+    QObject{parent}
+{
+    connect(app()->passwordStore(), &PasswordStore::passwordLoaded, this, &CacheManager::onPasswordLoaded);
+}
+
+CacheManager::~CacheManager() = default;
+
+QSharedPointer<MlDiskCache> CacheManager::diskCache(const QUuid& endpointUuid) const
+{
+    return diskCaches_.value(endpointUuid);
+}
+
+void CacheManager::update()
+{
+    const auto model = app()->endpointConfigModel();
+
+    QSet<QUuid> enabled;
+    for (int row = 0; row < model->rowCount(); ++row)
+    {
+        const auto uuid = model->data(model->index(row, toInt(EndpointConfig::Field::Uuid))).toUuid();
+        const auto diskCache = model->data(model->index(row, toInt(EndpointConfig::Field::DiskCache))).toBool();
+        const auto ttl = model->data(model->index(row, toInt(EndpointConfig::Field::DiskCacheTtl))).toInt();
+
+        if (uuid.isNull())
+            continue;
+
+        const auto key = keyUuid(uuid);
+        if (!keys_.contains(uuid) && !pendingKeys_.contains(key) && !unavailableKeys_.contains(uuid))
+        {
+            pendingKeys_.insert(key, uuid);
+            app()->passwordStore()->loadPassword(key, this);
+        }
+
+        if (!diskCache)
+        {
+            // Patient data must not stay on disk longer than wanted
+            if (!diskCaches_.contains(uuid))
+                QFile::remove(cacheFileName(uuid));
+            continue;
+        }
+
+        enabled.insert(uuid);
+        ttlHours_.insert(uuid, ttl);
+
+        if (auto cache = diskCaches_.value(uuid))
+        {
+            cache->setTtl(ttl * MsPerHour);
+            continue;
+        }
+
+        // Otherwise opened once the key is loaded
+        if (keys_.contains(uuid))
+            openDiskCache(uuid);
+    }
+
+    diskCacheEnabled_ = enabled;
+
+    for (auto it = diskCaches_.begin(); it != diskCaches_.end();)
+    {
+        if (enabled.contains(it.key()))
+        {
+            ++it;
+            continue;
+        }
+
+        it.value()->purge();
+        QFile::remove(it.value()->fileName());
+        it = diskCaches_.erase(it);
+    }
+}
+
+void CacheManager::purge()
+{
+    MlClient::purgeCaches();
+
+    for (const auto& cache : std::as_const(diskCaches_))
+    {
+        cache->purge();
+    }
+
+    // Files of endpoints without an open cache
+    QDir dir{cacheDirectory()};
+    const auto files = dir.entryList({QStringLiteral("*.mlc")}, QDir::Files);
+    for (const auto& file : files)
+    {
+        const auto uuid = QUuid::fromString(QFileInfo{file}.completeBaseName());
+        if (!diskCaches_.contains(uuid))
+            dir.remove(file);
+    }
+
+    QDir journalDir{journalDirectory()};
+    const auto journals = journalDir.entryList({QStringLiteral("*.mlj")}, QDir::Files);
+    for (const auto& file : journals)
+    {
+        journalDir.remove(file);
+    }
+
+    qCInfo(MLR_LOG_CAT) << "Record caches purged";
+}
+
+void CacheManager::onPasswordLoaded(bool result, const QUuid& uuid, const QString& passwd, void* context,
+                                    bool notFound)
+{
+    if (context != this)
+        return;
+
+    const auto endpointUuid = pendingKeys_.take(uuid);
+    if (endpointUuid.isNull())
+        return;
+
+    if (!result && !notFound)
+    {
+        // A new key would make the existing cache and journals unreadable for good, so do without them for now
+        unavailableKeys_.insert(endpointUuid);
+        qCWarning(MLR_LOG_CAT) << "Failed to read the cache key of endpoint" << endpointUuid
+                               << "from the keychain, disk cache and load journals are disabled for this session";
+        return;
+    }
+
+    auto key = QByteArray::fromBase64(passwd.toLatin1());
+    if (!result || key.size() != MlDiskCache::KeySize)
+    {
+        // No usable key yet, an existing cache file cannot be read anymore and is discarded on open
+        key = MlDiskCache::generateKey();
+        app()->passwordStore()->savePassword(uuid, QString::fromLatin1(key.toBase64()), this);
+    }
+
+    keys_.insert(endpointUuid, key);
+
+    if (diskCacheEnabled_.contains(endpointUuid) && !diskCaches_.contains(endpointUuid))
+        openDiskCache(endpointUuid);
+}
+
+QSharedPointer<MlDiskCache> CacheManager::openJournal(const QUuid& endpointUuid, const QString& runId) const
+{
+    const auto key = keys_.value(endpointUuid);
+    if (key.isEmpty())
+        return {};
+
+    const auto fileName = journalDirectory() + QLatin1Char('/') + endpointUuid.toString(QUuid::WithoutBraces) +
+            QLatin1Char('-') + runId + QStringLiteral(".mlj");
+
+    auto journal = QSharedPointer<MlDiskCache>::create(fileName, key);
+    journal->setTtl(JournalTtlMs);
+    if (!journal->open())
+    {
+        qCWarning(MLR_LOG_CAT) << "Failed to open load journal" << fileName << ":" << journal->errorString();
+        return {};
+    }
+
+    return journal;
+}
+
+void CacheManager::removeJournal(const QSharedPointer<MlDiskCache>& journal)
+{
+    if (!journal)
+        return;
+
+    journal->purge();
+    QFile::remove(journal->fileName());
+}
+
+void CacheManager::openDiskCache(const QUuid& endpointUuid)
+{
+    auto cache = QSharedPointer<MlDiskCache>::create(cacheFileName(endpointUuid), keys_.value(endpointUuid));
+    cache->setTtl(ttlHours_.value(endpointUuid, 24) * MsPerHour);
+    if (!cache->open())
+    {
+        qCWarning(MLR_LOG_CAT) << "Failed to open record cache" << cache->fileName() << ":" << cache->errorString();
+        return;
+    }
+
+    diskCaches_.insert(endpointUuid, cache);
+}
+
+QUuid CacheManager::keyUuid(const QUuid& endpointUuid)
+{
+    return QUuid::createUuidV5(endpointUuid, KeyNamespace);
+}
+
+QString CacheManager::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/records");
+}
+
+QString CacheManager::journalDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/journals");
+}
+
+QString CacheManager::cacheFileName(const QUuid& endpointUuid)
+{
+    return cacheDirectory() + QLatin1Char('/') + endpointUuid.toString(QUuid::WithoutBraces) + QStringLiteral(".mlc");
+}
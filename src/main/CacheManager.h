@@ -0,0 +1,59 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QUuid>
+
+class MlDiskCache;
+
+// Owns the encrypted disk caches of the endpoints which have one enabled. The key of each cache is kept in the
+// PasswordStore under a UUID derived from the endpoint UUID, a new key is generated on first use.
+//
+// The same key encrypts the checkpoint journals of bulk loads, so keys are loaded for all endpoints.
+class CacheManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CacheManager(QObject* parent = {});
+    ~CacheManager() override;
+
+    // Null until the key is loaded from the keychain or if the endpoint has no disk cache
+    QSharedPointer<MlDiskCache> diskCache(const QUuid& endpointUuid) const;
+
+    // Opens the journal of a bulk load, an existing journal of the same run is continued. Null until the key is loaded.
+    QSharedPointer<MlDiskCache> openJournal(const QUuid& endpointUuid, const QString& runId) const;
+    static void removeJournal(const QSharedPointer<MlDiskCache>& journal);
+
+public slots:
+    // Opens or drops disk caches according to the endpoint configuration
+    void update();
+    // Clears all memory caches and deletes all disk caches and journals
+    void purge();
+
+private slots:
+    void onPasswordLoaded(bool result, const QUuid& uuid, const QString& passwd, void* context, bool notFound);
+
+private:
+    void openDiskCache(const QUuid& endpointUuid);
+
+    static QUuid keyUuid(const QUuid& endpointUuid);
+    static QString cacheDirectory();
+    static QString cacheFileName(const QUuid& endpointUuid);
+    static QString journalDirectory();
+
+private:
+    QHash<QUuid, QByteArray> keys_;
+    QSet<QUuid> diskCacheEnabled_;
+    QHash<QUuid, QSharedPointer<MlDiskCache>> diskCaches_;
+    // Endpoint UUID by key UUID of the keys being loaded
+    QHash<QUuid, QUuid> pendingKeys_;
+    // Endpoints whose key could not be read, they stay without disk cache for the session
+    QSet<QUuid> unavailableKeys_;
+    QHash<QUuid, int> ttlHours_;
+};
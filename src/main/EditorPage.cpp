@@ -5,17 +5,33 @@
 #include "ui_EditorPage.h"
 
 #include "Application.h"
+#include "CsvReader.h"
+#include "DataModel.h"
+#include "EditorSaveQueue.h"
 #include "EndpointConfig.h"
 #include "EndpointConfigModel.h"
 #include "EndpointSelector.h"
 #include "MainWindow.h"
 #include "MlClientTools.h"
 #include "Tools.h"
+#include "UserSettings.h"
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMenu>
 #include <QMessageBox>
 
+namespace {
+
+// Patients ahead in the navigation list which are read into the record cache in the background
+constexpr qsizetype PrefetchCount = 5;
+
+} // namespace
+
 EditorPage::EditorPage(QWidget *parent) :
     QWidget{parent},
-    ui{new Ui::EditorPage{}}
+    ui{new Ui::EditorPage{}},
+    saveQueue_{new EditorSaveQueue{this}}
 {
     ui->setupUi(this);
 }
@@ -23,6 +39,7 @@ EditorPage::EditorPage(QWidget *parent) :
 EditorPage::~EditorPage()
 {
     saveWidgetState();
+    resetPrefetchClient();
 
     delete ui;
 }
@@ -39,6 +56,14 @@ void EditorPage::initialize(MainWindow* mainWindow)
     connect(ui->loadIDataBtn, &QAbstractButton::clicked, this, &EditorPage::onLoadIDataBtnClicked);
     connect(ui->saveBtn, &QAbstractButton::clicked, this, &EditorPage::onSaveBtnClicked);
     connect(ui->abortBtn, &QAbstractButton::clicked, this, &EditorPage::onAbortBtnClicked);
+    connect(ui->prevPatientBtn, &QAbstractButton::clicked, this, &EditorPage::onPrevPatientBtnClicked);
+    connect(ui->nextPatientBtn, &QAbstractButton::clicked, this, &EditorPage::onNextPatientBtnClicked);
+    connect(ui->bulkEditBtn, &QAbstractButton::clicked, this, &EditorPage::onBulkEditBtnClicked);
+    connect(ui->failedSavesBtn, &QAbstractButton::clicked, this, &EditorPage::onFailedSavesBtnClicked);
+
+    connect(saveQueue_, &EditorSaveQueue::logMessage, mainWindow_, &MainWindow::logMessage);
+    connect(saveQueue_, &EditorSaveQueue::changed, this, &EditorPage::onSaveQueueChanged);
+    onSaveQueueChanged();
 
     loadWidgetState();
 
@@ -60,6 +85,15 @@ void EditorPage::updateUiState()
 
     ui->searchPid->setEnabled(endpointSelected && !dataLoaded);
     ui->loadIDataBtn->setEnabled(endpointSelected && !dataLoaded);
+    ui->bulkEditBtn->setEnabled(endpointSelected && !dataLoaded);
+
+    const bool navigating = !navigationPids_.isEmpty();
+    ui->prevPatientBtn->setVisible(navigating);
+    ui->nextPatientBtn->setVisible(navigating);
+    ui->navigationPosition->setVisible(navigating);
+    ui->prevPatientBtn->setEnabled(endpointSelected && navigationIndex_ > 0);
+    ui->nextPatientBtn->setEnabled(endpointSelected && navigationIndex_ + 1 < navigationPids_.size());
+    ui->navigationPosition->setText(tr("%1 / %2").arg(navigationIndex_ + 1).arg(navigationPids_.size()));
     ui->saveBtn->setEnabled(dataLoaded);
     ui->abortBtn->setEnabled(dataLoaded);
     ui->patientDataForm->setEnabled(dataLoaded);
@@ -82,10 +116,26 @@ void EditorPage::changeEvent(QEvent* event)
 
 void EditorPage::startEditing(const QString& pid)
 {
+    navigationPids_.clear();
+    navigationIndex_ = -1;
+
     ui->searchPid->setText(pid);
     startEditing();
 }
 
+void EditorPage::startEditing(const QStringList& pids, qsizetype index)
+{
+    if (index < 0 || index >= pids.size())
+        return;
+
+    navigateTo(pids, index);
+}
+
+int EditorPage::pendingSaveCount() const
+{
+    return saveQueue_->pendingCount();
+}
+
 void EditorPage::startEditing()
 {
     const auto pid = ui->searchPid->text();
@@ -124,21 +174,183 @@ void EditorPage::reloadDynamicForm(int endpointIndex)
     ui->patientDataForm->reset(dynamicFields);
 }
 
+QList<EditorRun::Edit> EditorPage::makeBulkEdits(DataModel* input)
+{
+    const int endpointIndex = mainWindow_->endpointSelector()->selectedEndpoint();
+    const auto model = app()->endpointConfigModel();
+    const auto fields = model->data(model->index(endpointIndex, toInt(EndpointConfig::Field::Fields)),
+                                    Qt::DisplayRole).toStringList();
+
+    const int pidColumn = input->detectedPidColumn();
+
+    QHash<int, QString> columnFields;
+    QStringList ignored;
+    for (int column = 0; column < input->columnCount(); ++column)
+    {
+        if (column == pidColumn)
+            continue;
+
+        const auto header = input->headerData(column, Qt::Horizontal, Qt::DisplayRole).toString().trimmed();
+        if (fields.contains(header))
+            columnFields.insert(column, header);
+        else
+            ignored << header;
+    }
+
+    if (!ignored.isEmpty())
+    {
+        mainWindow_->logMessage(QtWarningMsg, tr("Bulk edit ignores columns which are no endpoint fields: %1")
+                                .arg(ignored.join(QStringLiteral(", "))));
+    }
+
+    const auto validator = createPidValidator(endpointIndex);
+
+    // Rows of the same PID are merged, so two edits of one patient never race each other
+    QList<EditorRun::Edit> edits;
+    QHash<QString, qsizetype> editIndex;
+    int invalid = 0;
+    for (int row = 0; row < input->rowCount(); ++row)
+    {
+        const auto check = validator.check(input->data(input->index(row, pidColumn), Qt::DisplayRole).toString());
+        if (!check.valid)
+        {
+            ++invalid;
+            continue;
+        }
+
+        // An empty cell leaves the field unchanged
+        QHash<QString, QString> changes;
+        for (auto it = columnFields.cbegin(); it != columnFields.cend(); ++it)
+        {
+            const auto value = input->data(input->index(row, it.key()), Qt::DisplayRole).toString();
+            if (!value.isEmpty())
+                changes.insert(it.value(), value);
+        }
+        if (changes.isEmpty())
+            continue;
+
+        const auto it = editIndex.constFind(check.pid);
+        if (it != editIndex.cend())
+        {
+            edits[it.value()].fields.insert(changes);
+            continue;
+        }
+
+        editIndex.insert(check.pid, edits.size());
+        edits << EditorRun::Edit{check.pid, changes};
+    }
+
+    if (invalid > 0)
+        mainWindow_->logMessage(QtWarningMsg, tr("%1 rows have an invalid PID and are skipped").arg(invalid));
+
+    return edits;
+}
+
+void EditorPage::navigateTo(const QStringList& pids, qsizetype index)
+{
+    const auto changes = ui->patientDataForm->extractFormData(DynamicForm::Filter::Modified);
+    if (!loadedPatientPid_.isEmpty() && !changes.isEmpty())
+    {
+        const auto answer = QMessageBox::question(
+                    this,
+                    tr("Unsaved changes"),
+                    tr("Discard the changes of patient %1?").arg(loadedPatientPid_),
+                    QMessageBox::Yes | QMessageBox::No,
+                    QMessageBox::No);
+        if (answer != QMessageBox::Yes)
+            return;
+    }
+
+    // Declining to discard the changes keeps the editor in its current list
+    navigationPids_ = pids;
+    navigationIndex_ = index;
+    ui->searchPid->setText(navigationPids_[index]);
+    startEditing();
+
+    prefetch(index);
+}
+
+void EditorPage::prefetch(qsizetype index)
+{
+    // The previous patient is usually cached already and skipped
+    QStringList pids;
+    for (auto i = qMax<qsizetype>(0, index - 1); i <= index + PrefetchCount && i < navigationPids_.size(); ++i)
+    {
+        if (i != index)
+            pids << navigationPids_[i];
+    }
+    if (pids.isEmpty())
+        return;
+
+    const auto endpointIndex = mainWindow_->endpointSelector()->selectedEndpoint();
+    const auto apiKey = mainWindow_->endpointSelector()->currentApiKey();
+    if (prefetchClient_ && (prefetchEndpointIndex_ != endpointIndex || prefetchApiKey_ != apiKey))
+        resetPrefetchClient();
+
+    // Kept across steps, it knows which patients are still being prefetched
+    if (!prefetchClient_)
+    {
+        prefetchClient_ = createMlClientIntern(endpointIndex, apiKey);
+        prefetchClient_->setPriority(MlClient::Priority::Background);
+        prefetchEndpointIndex_ = endpointIndex;
+        prefetchApiKey_ = apiKey;
+    }
+
+    // Fills the record cache shared by all clients of the endpoint. A step onto a patient whose prefetch is still
+    // running joins its read.
+    prefetchClient_->prefetchPatientData(pids, mainWindow_->endpointSelector()->currentFieldList());
+}
+
+void EditorPage::resetPrefetchClient()
+{
+    if (!prefetchClient_)
+        return;
+
+    prefetchClient_->deleteWhenIdle();
+    prefetchClient_ = nullptr;
+}
+
 void EditorPage::onLoadIDataBtnClicked()
 {
+    navigationPids_.clear();
+    navigationIndex_ = -1;
+
     startEditing();
 }
 
+void EditorPage::onPrevPatientBtnClicked()
+{
+    if (navigationIndex_ > 0)
+        navigateTo(navigationPids_, navigationIndex_ - 1);
+}
+
+void EditorPage::onNextPatientBtnClicked()
+{
+    if (navigationIndex_ + 1 < navigationPids_.size())
+        navigateTo(navigationPids_, navigationIndex_ + 1);
+}
+
 void EditorPage::onSaveBtnClicked()
 {
     Q_ASSERT(!loadedPatientPid_.isEmpty());
 
-    auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
-                                   mainWindow_->endpointSelector()->currentApiKey(),
-                                   mainWindow_, &MainWindow::logMessage);
-    mlClientEditPatientData(mlClient, loadedPatientPid_,
-                            ui->patientDataForm->extractFormData(DynamicForm::Filter::Modified),
-                            this, &EditorPage::onPatientDataEditingDone);
+    const auto fields = ui->patientDataForm->extractFormData(DynamicForm::Filter::Modified);
+    if (fields.isEmpty())
+    {
+        mainWindow_->showStatusMessage(tr("No changes to save"), 1000);
+        return;
+    }
+
+    // Committed in the background, the next patient can be loaded right away
+    saveQueue_->enqueue(mainWindow_->endpointSelector()->selectedEndpoint(),
+                        mainWindow_->endpointSelector()->currentApiKey(),
+                        loadedPatientPid_, fields);
+    mainWindow_->showStatusMessage(tr("Saving patient %1 in the background").arg(loadedPatientPid_), 1000);
+
+    loadedPatientPid_ = QString{};
+    updateUiState();
+    ui->searchPid->selectAll();
+    ui->searchPid->setFocus();
 }
 
 void EditorPage::onAbortBtnClicked()
@@ -147,6 +359,68 @@ void EditorPage::onAbortBtnClicked()
     updateUiState();
 }
 
+void EditorPage::onBulkEditBtnClicked()
+{
+    UserSettings s;
+
+    auto fileName = QFileDialog::getOpenFileName(
+                this,
+                tr("Open patient changes file (csv list)"),
+                s.stringValue(CfgLastAccessedDirectory),
+                tr("CSV Files (*.csv);;All Files (*.*)")
+                );
+
+    if (fileName.isEmpty())
+        return;
+
+    QFileInfo fi{fileName};
+    s.setValue(CfgLastAccessedDirectory, fi.absolutePath());
+
+    DataModel input;
+    QFile file{fileName};
+    CsvReader csvReader{};
+    if (!file.open(QFile::ReadOnly) || !csvReader.read(file, &input))
+    {
+        mainWindow_->showStatusMessage(tr("Failed to read patient changes file"), 5000);
+        return;
+    }
+
+    if (!input.firstRowHeader() || input.detectedPidColumn() == -1)
+    {
+        mainWindow_->showStatusMessage(tr("The first row of the changes file must name a PID column"), 5000);
+        return;
+    }
+
+    const auto edits = makeBulkEdits(&input);
+    if (edits.isEmpty())
+    {
+        mainWindow_->showStatusMessage(tr("No changes in patient changes file"), 5000);
+        return;
+    }
+
+    const auto answer = QMessageBox::question(
+                this,
+                tr("Bulk edit"),
+                tr("Apply the changes to %1 patients?").arg(edits.size()),
+                QMessageBox::Yes | QMessageBox::No,
+                QMessageBox::No);
+    if (answer != QMessageBox::Yes)
+        return;
+
+    setEnabled(false);
+    mainWindow_->showStatusMessage(tr("Editing %1 patients ...").arg(edits.size()));
+
+    auto run = new EditorRun{mainWindow_->endpointSelector()->selectedEndpoint(),
+                             mainWindow_->endpointSelector()->currentApiKey(),
+                             edits, this};
+    connect(run, &EditorRun::logMessage, mainWindow_, &MainWindow::logMessage);
+    connect(run, &EditorRun::progress, this, [this](int done, int total) {
+        mainWindow_->showStatusMessage(tr("Editing patients ... %1 of %2").arg(done).arg(total));
+    });
+    connect(run, &EditorRun::finished, this, &EditorPage::onBulkEditingDone);
+    run->start();
+}
+
 void EditorPage::onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData)
 {
     if (error)
@@ -160,9 +434,25 @@ void EditorPage::onPatientDataLoadingDone(const MlClient::Error& error, const Ml
 
         mainWindow_->showStatusMessage(tr("Failed to load patient data"), 5000);
     }
+    else if (patientData.isEmpty())
+    {
+        mainWindow_->showStatusMessage(tr("Patient %1 not found").arg(ui->searchPid->text()), 5000);
+    }
     else
     {
-        ui->patientDataForm->fillFormData(patientData[0]);
+        auto record = patientData[0];
+
+        // Saves still in the queue are newer than what the server returned
+        const auto pendingFields = saveQueue_->pendingFields(mainWindow_->endpointSelector()->selectedEndpoint(),
+                                                             ui->searchPid->text());
+        if (!pendingFields.isEmpty())
+        {
+            record.insert(pendingFields);
+            mainWindow_->logMessage(QtInfoMsg, tr("Patient %1 has saves pending, showing their values")
+                                    .arg(ui->searchPid->text()));
+        }
+
+        ui->patientDataForm->fillFormData(record);
         loadedPatientPid_ = ui->searchPid->text();
 
         mainWindow_->showStatusMessage(tr("Patient data loaded"), 1000);
@@ -173,31 +463,78 @@ void EditorPage::onPatientDataLoadingDone(const MlClient::Error& error, const Ml
     deleteSenderMlClient(sender());
 }
 
-void EditorPage::onPatientDataEditingDone(const MlClient::Error& error)
+void EditorPage::onBulkEditingDone(const MlClient::Error& error, const QHash<QString, QString>& failedPids)
 {
     if (error)
     {
         QMessageBox::warning(
                     this,
                     tr("Error"),
-                    tr("Error while edit patient data: %1").arg(error.message),
+                    tr("Error while editing patients: %1").arg(error.message),
                     QMessageBox::Ok,
                     QMessageBox::Ok);
 
-        mainWindow_->showStatusMessage(tr("Failed to edit patient data"), 5000);
+        mainWindow_->showStatusMessage(tr("Failed to edit patients"), 5000);
+    }
+    else if (!failedPids.isEmpty())
+    {
+        const auto message = tr("Bulk edit done, %1 edits failed. Run the same file again to retry them.")
+                .arg(failedPids.size());
+        mainWindow_->logMessage(QtWarningMsg, message);
+        mainWindow_->showStatusMessage(message, 5000);
     }
     else
     {
-        mainWindow_->showStatusMessage(tr("Patient data edited"), 1000);
+        mainWindow_->logMessage(QtInfoMsg, tr("Bulk edit done"));
+        mainWindow_->showStatusMessage(tr("Patients edited"), 1000);
     }
 
     setEnabled(true);
     updateUiState();
-    deleteSenderMlClient(sender());
+    sender()->deleteLater();
+}
+
+void EditorPage::onFailedSavesBtnClicked()
+{
+    QMenu menu;
+
+    for (const auto& save : saveQueue_->failed())
+    {
+        auto saveMenu = menu.addMenu(tr("%1: %2").arg(save.pid, save.error));
+        const auto id = save.id;
+        saveMenu->addAction(QIcon::fromTheme(QStringLiteral("view-refresh")), tr("&Retry"), this, [this, id]() {
+            saveQueue_->retry(id);
+        });
+        saveMenu->addAction(QIcon::fromTheme(QStringLiteral("edit-delete")), tr("&Discard"), this, [this, id]() {
+            saveQueue_->discard(id);
+        });
+    }
+
+    menu.addSeparator();
+    menu.addAction(QIcon::fromTheme(QStringLiteral("view-refresh")), tr("Retry &all"), this, [this]() {
+        saveQueue_->retryAll();
+    });
+    menu.addAction(QIcon::fromTheme(QStringLiteral("edit-delete")), tr("Discard a&ll"), this, [this]() {
+        saveQueue_->discardAll();
+    });
+
+    menu.exec(ui->failedSavesBtn->mapToGlobal(QPoint{0, ui->failedSavesBtn->height()}));
+}
+
+void EditorPage::onSaveQueueChanged()
+{
+    const int pending = saveQueue_->pendingCount();
+    const auto failed = saveQueue_->failed().size();
+
+    ui->saveQueueStatus->setText(pending > 0 ? tr("Saving %1 ...").arg(pending) : QString{});
+    ui->failedSavesBtn->setText(tr("%1 failed saves").arg(failed));
+    ui->failedSavesBtn->setVisible(failed > 0);
 }
 
 void EditorPage::onEndpointConfigChanged()
 {
+    // The client was set up from the old config
+    resetPrefetchClient();
     reloadDynamicForm(mainWindow_->endpointSelector()->selectedEndpoint());
 }
 
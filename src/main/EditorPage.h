@@ -3,10 +3,12 @@
 
 #pragma once
 
+#include "EditorRun.h"
 #include "MlClient.h"
 #include <QWidget>
 
 class DataModel;
+class EditorSaveQueue;
 class MainWindow;
 
 namespace Ui {
@@ -24,6 +26,10 @@ public:
     void initialize(MainWindow* mainWindow);
 
     void startEditing(const QString& pid);
+    // Edits pids[index], the other patients of the list are reached with previous and next
+    void startEditing(const QStringList& pids, qsizetype index);
+    // Saves queued or still being committed
+    int pendingSaveCount() const;
 
 protected:
     void changeEvent(QEvent* event) override;
@@ -32,8 +38,13 @@ private slots:
     void onLoadIDataBtnClicked();
     void onSaveBtnClicked();
     void onAbortBtnClicked();
+    void onPrevPatientBtnClicked();
+    void onNextPatientBtnClicked();
+    void onBulkEditBtnClicked();
+    void onFailedSavesBtnClicked();
+    void onSaveQueueChanged();
     void onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData);
-    void onPatientDataEditingDone(const MlClient::Error& error);
+    void onBulkEditingDone(const MlClient::Error& error, const QHash<QString, QString>& failedPids);
     void onEndpointConfigChanged();
     void onSelectedEndpointChanged(int index);
 
@@ -43,11 +54,21 @@ private:
     void updateUiState();
     void startEditing();
     void reloadDynamicForm(int endpointIndex);
+    QList<EditorRun::Edit> makeBulkEdits(DataModel* input);
+    void navigateTo(const QStringList& pids, qsizetype index);
+    void prefetch(qsizetype index);
+    void resetPrefetchClient();
 
 private:
     Ui::EditorPage* ui;
     MainWindow* mainWindow_{};
     QString loadedPatientPid_{};
+    EditorSaveQueue* saveQueue_;
+    QStringList navigationPids_{};
+    qsizetype navigationIndex_{-1};
+    MlClient* prefetchClient_{};
+    int prefetchEndpointIndex_{-1};
+    QString prefetchApiKey_{};
 
     Q_DISABLE_COPY_MOVE(EditorPage)
 };
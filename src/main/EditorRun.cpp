@@ -0,0 +1,206 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "EditorRun.h"
+
+#include "Application.h"
+#include "CacheManager.h"
+#include "EndpointConfigModel.h"
+#include "MlClientTools.h"
+#include "MlDiskCache.h"
+#include "MlRecordCache.h"
+#include "Tools.h"
+#include <QCryptographicHash>
+#include <QUuid>
+
+EditorRun::EditorRun(int endpointIndex, QString apiKey, QList<Edit> edits, QObject* parent) :
+    QObject{parent},
+    endpointIndex_{endpointIndex},
+    apiKey_{std::move(apiKey)},
+    edits_{std::move(edits)}
+{
+}
+
+EditorRun::~EditorRun() = default;
+
+void EditorRun::start()
+{
+    const auto model = app()->endpointConfigModel();
+    const auto uuid = model->data(model->index(endpointIndex_, toInt(EndpointConfig::Field::Uuid)),
+                                  Qt::DisplayRole).toUuid();
+
+    journal_ = app()->cacheManager()->openJournal(uuid, runId());
+    if (journal_)
+    {
+        resume();
+    }
+    else
+    {
+        emit logMessage(QtWarningMsg, tr("No edit journal available, an interrupted bulk edit can not be resumed"));
+        remaining_ = edits_;
+    }
+
+    if (remaining_.isEmpty())
+    {
+        QMetaObject::invokeMethod(this, &EditorRun::finishIfDone, Qt::QueuedConnection);
+        return;
+    }
+
+    while (editsRunning_ < EditsInFlight && pos_ < remaining_.size())
+    {
+        startNextEdit();
+    }
+}
+
+QString EditorRun::runId() const
+{
+    // Any change to the PIDs or values makes it another run, a journal never vouches for values it did not send
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    for (const auto& edit : edits_)
+    {
+        auto fields = edit.fields.keys();
+        fields.sort();
+
+        hash.addData(edit.pid.toUtf8());
+        for (const auto& field : std::as_const(fields))
+        {
+            hash.addData(QByteArrayView{"\0", 1});
+            hash.addData(field.toUtf8());
+            hash.addData(QByteArrayView{"\0", 1});
+            hash.addData(edit.fields.value(field).toUtf8());
+        }
+        hash.addData(QByteArrayView{"\n", 1});
+    }
+    return QString::fromLatin1(hash.result().toHex().left(32));
+}
+
+void EditorRun::resume()
+{
+    int inFlight = 0;
+    for (const auto& edit : std::as_const(edits_))
+    {
+        MlDiskCache::Record entry;
+        if (!journal_->read(edit.pid, entry))
+        {
+            remaining_ << edit;
+            continue;
+        }
+
+        // Values carry the time the server confirmed them, 0 while the edit was in flight
+        bool applied = !entry.fields.isEmpty();
+        for (const auto& value : std::as_const(entry.fields))
+        {
+            applied = applied && value.fetchedMs > 0;
+        }
+
+        if (applied)
+        {
+            ++skipped_;
+        }
+        else
+        {
+            ++inFlight;
+            remaining_ << edit;
+        }
+    }
+
+    done_ = skipped_;
+
+    if (skipped_ > 0 || inFlight > 0)
+    {
+        emit logMessage(QtInfoMsg, tr("Resuming interrupted bulk edit, %1 of %2 edits were applied before, "
+                                      "%3 were in flight and are sent again")
+                        .arg(QString::number(skipped_), QString::number(edits_.size()), QString::number(inFlight)));
+        emit progress(done_, static_cast<int>(edits_.size()));
+    }
+}
+
+void EditorRun::startNextEdit()
+{
+    const auto edit = remaining_[pos_++];
+    ++editsRunning_;
+
+    // Written ahead, so a crash during the request leaves a trace of it
+    journal(edit, 0);
+
+    auto mlClient = createMlClientIntern(endpointIndex_, apiKey_);
+    mlClient->setPriority(MlClient::Priority::Bulk);
+
+    connect(mlClient, &MlClient::logMessage, this, &EditorRun::logMessage);
+    connect(mlClient, &MlClient::patientDataEditingDone, this, [this, mlClient, edit](const MlClient::Error& error) {
+        mlClient->deleteWhenIdle();
+        onEditDone(edit, error);
+    });
+
+    mlClient->editPatientData(edit.pid, edit.fields);
+}
+
+void EditorRun::onEditDone(const Edit& edit, const MlClient::Error& error)
+{
+    --editsRunning_;
+    ++done_;
+
+    if (error)
+    {
+        // The journal keeps the edit as in flight, it is sent again when the run is resumed
+        failedPids_.insert(edit.pid, error.message);
+        emit logMessage(QtWarningMsg, tr("Failed to edit patient %1: %2").arg(edit.pid, error.message));
+
+        // Only a bad request is about this edit, any other error would fail the following edits as well
+        if (error.statusCode != 400 && !error_)
+            error_ = error;
+    }
+    else
+    {
+        journal(edit, MlRecordCache::now());
+    }
+
+    emit progress(done_, static_cast<int>(edits_.size()));
+
+    if (!error_ && pos_ < remaining_.size())
+        startNextEdit();
+
+    finishIfDone();
+}
+
+void EditorRun::journal(const Edit& edit, qint64 appliedMs)
+{
+    if (!journal_)
+        return;
+
+    MlDiskCache::Record entry;
+    entry.seenMs = MlRecordCache::now();
+    for (auto it = edit.fields.cbegin(); it != edit.fields.cend(); ++it)
+    {
+        entry.fields.insert(it.key(), MlDiskCache::Value{it.value(), true, appliedMs});
+    }
+    journal_->write(edit.pid, entry);
+}
+
+void EditorRun::finishIfDone()
+{
+    if (editsRunning_ > 0 || (!error_ && pos_ < remaining_.size()))
+        return;
+
+    if (error_)
+    {
+        emit logMessage(QtWarningMsg, tr("Bulk edit interrupted after %1 of %2 edits, it resumes when started again")
+                        .arg(QString::number(done_), QString::number(edits_.size())));
+        emit finished(error_, failedPids_);
+        return;
+    }
+
+    if (skipped_ > 0)
+        emit logMessage(QtInfoMsg, tr("%1 edits were skipped, the journal shows them applied").arg(skipped_));
+
+    if (failedPids_.isEmpty())
+    {
+        CacheManager::removeJournal(journal_);
+        journal_.reset();
+    }
+
+    MlClient::Error result;
+    if (!failedPids_.isEmpty() && failedPids_.size() == remaining_.size())
+        result = MlClient::Error{tr("All %1 edits failed").arg(failedPids_.size())};
+    emit finished(result, failedPids_);
+}
@@ -0,0 +1,63 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlClient.h"
+#include <QObject>
+#include <QSharedPointer>
+
+class MlDiskCache;
+
+// A bulk edit of the Editor. Edits run concurrently, but fewer at once than reads since every write locks the patient
+// on the server. Each edit is written to an encrypted write-ahead journal before it is sent and marked applied once
+// the server confirmed it. Running the same edits again resumes the run: applied edits are skipped, edits that were
+// in flight are sent again, which is safe because an edit sets absolute values. The journal is removed when the run
+// completes without failures. An error that is not about a single edit (e.g. authentication or network) stops the run
+// before further edits are sent.
+class EditorRun : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Edit
+    {
+        QString pid{};
+        QHash<QString, QString> fields{};
+    };
+
+    static constexpr int EditsInFlight = 2;
+
+public:
+    EditorRun(int endpointIndex, QString apiKey, QList<Edit> edits, QObject* parent = {});
+    ~EditorRun() override;
+
+    void start();
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    void progress(int done, int total);
+    // failedPids holds the server's message for each PID whose edit failed, all other edits are applied
+    void finished(const MlClient::Error& error, const QHash<QString, QString>& failedPids);
+
+private:
+    QString runId() const;
+    void resume();
+    void startNextEdit();
+    void onEditDone(const Edit& edit, const MlClient::Error& error);
+    void journal(const Edit& edit, qint64 appliedMs);
+    void finishIfDone();
+
+private:
+    int endpointIndex_;
+    QString apiKey_;
+    QList<Edit> edits_;
+    QSharedPointer<MlDiskCache> journal_;
+    QList<Edit> remaining_;
+    qsizetype pos_{};
+    int editsRunning_{};
+    int done_{};
+    int skipped_{};
+    QHash<QString, QString> failedPids_;
+    MlClient::Error error_;
+};
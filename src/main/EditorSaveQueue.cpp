@@ -0,0 +1,160 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "EditorSaveQueue.h"
+
+#include "MlClientTools.h"
+#include <algorithm>
+
+EditorSaveQueue::EditorSaveQueue(QObject* parent) :
+    QObject{parent}
+{
+}
+
+void EditorSaveQueue::enqueue(int endpointIndex, const QString& apiKey, const QString& pid,
+                              const QHash<QString, QString>& fields)
+{
+    queue_ << Save{nextId_++, endpointIndex, apiKey, pid, fields};
+
+    startSaves();
+    emit changed();
+}
+
+QHash<QString, QString> EditorSaveQueue::pendingFields(int endpointIndex, const QString& pid) const
+{
+    QHash<QString, QString> fields;
+
+    const auto running = running_.constFind(patientKey(endpointIndex, pid));
+    if (running != running_.cend())
+        fields.insert(running->fields);
+
+    for (const auto& save : queue_)
+    {
+        if (save.endpointIndex == endpointIndex && save.pid == pid)
+            fields.insert(save.fields);
+    }
+
+    return fields;
+}
+
+void EditorSaveQueue::retry(qint64 id)
+{
+    for (qsizetype i = 0; i < failed_.size(); ++i)
+    {
+        if (failed_[i].id != id)
+            continue;
+
+        auto save = failed_.takeAt(i);
+        save.error.clear();
+        // Goes before the saves of the same PID held back behind it
+        queue_.prepend(save);
+
+        startSaves();
+        emit changed();
+        return;
+    }
+}
+
+void EditorSaveQueue::discard(qint64 id)
+{
+    for (qsizetype i = 0; i < failed_.size(); ++i)
+    {
+        if (failed_[i].id != id)
+            continue;
+
+        const auto save = failed_.takeAt(i);
+        emit logMessage(QtWarningMsg, tr("Discarded failed save of patient %1").arg(save.pid));
+
+        startSaves();
+        emit changed();
+        return;
+    }
+}
+
+void EditorSaveQueue::retryAll()
+{
+    if (failed_.isEmpty())
+        return;
+
+    // Failed saves go first, later saves of the same PID are queued after them
+    for (auto& save : failed_)
+    {
+        save.error.clear();
+    }
+    queue_ = failed_ + queue_;
+    failed_.clear();
+
+    startSaves();
+    emit changed();
+}
+
+void EditorSaveQueue::discardAll()
+{
+    if (failed_.isEmpty())
+        return;
+
+    emit logMessage(QtWarningMsg, tr("Discarded %1 failed saves").arg(failed_.size()));
+    failed_.clear();
+
+    startSaves();
+    emit changed();
+}
+
+QString EditorSaveQueue::patientKey(int endpointIndex, const QString& pid)
+{
+    return QString::number(endpointIndex) + QLatin1Char('\n') + pid;
+}
+
+void EditorSaveQueue::startSaves()
+{
+    // The first queued save of each patient is the next one of that patient, later ones wait until it is committed.
+    // Saves behind a failed one wait until it is retried or discarded, so they are never overwritten by it.
+    for (qsizetype i = 0; i < queue_.size() && running_.size() < SavesInFlight;)
+    {
+        const auto key = patientKey(queue_[i].endpointIndex, queue_[i].pid);
+        if (running_.contains(key) || hasFailed(key))
+        {
+            ++i;
+            continue;
+        }
+
+        startSave(queue_.takeAt(i));
+    }
+}
+
+bool EditorSaveQueue::hasFailed(const QString& key) const
+{
+    return std::any_of(failed_.cbegin(), failed_.cend(), [&key](const Save& save) {
+        return patientKey(save.endpointIndex, save.pid) == key;
+    });
+}
+
+void EditorSaveQueue::startSave(const Save& save)
+{
+    running_.insert(patientKey(save.endpointIndex, save.pid), save);
+
+    auto mlClient = createMlClientIntern(save.endpointIndex, save.apiKey);
+
+    connect(mlClient, &MlClient::logMessage, this, &EditorSaveQueue::logMessage);
+    connect(mlClient, &MlClient::patientDataEditingDone, this, [this, mlClient, save](const MlClient::Error& error) {
+        mlClient->deleteWhenIdle();
+        onSaveDone(save, error);
+    });
+
+    mlClient->editPatientData(save.pid, save.fields);
+}
+
+void EditorSaveQueue::onSaveDone(Save save, const MlClient::Error& error)
+{
+    running_.remove(patientKey(save.endpointIndex, save.pid));
+
+    if (error)
+    {
+        save.error = error.message;
+        emit logMessage(QtWarningMsg, tr("Failed to save patient %1: %2").arg(save.pid, error.message));
+        failed_ << save;
+    }
+
+    startSaves();
+    emit changed();
+}
@@ -0,0 +1,69 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlClient.h"
+#include <QList>
+#include <QObject>
+#include <QSet>
+
+// Commits the saves of the Editor in the background, so editing can go on while a save takes its round trips.
+// Saves of the same PID and endpoint are committed one after another in the order they were queued, other saves run
+// concurrently. A failed save is kept for review until it is retried or discarded.
+class EditorSaveQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Save
+    {
+        qint64 id{};
+        int endpointIndex{};
+        QString apiKey{};
+        QString pid{};
+        QHash<QString, QString> fields{};
+        // Set for failed saves
+        QString error{};
+    };
+
+    static constexpr int SavesInFlight = 2;
+
+public:
+    explicit EditorSaveQueue(QObject* parent = {});
+
+    void enqueue(int endpointIndex, const QString& apiKey, const QString& pid, const QHash<QString, QString>& fields);
+
+    // Queued and running saves
+    int pendingCount() const { return static_cast<int>(queue_.size()) + static_cast<int>(running_.size()); }
+    const QList<Save>& failed() const { return failed_; }
+
+    // The values of the saves of pid on the endpoint not committed yet, the server may still return older ones
+    QHash<QString, QString> pendingFields(int endpointIndex, const QString& pid) const;
+
+    void retry(qint64 id);
+    void discard(qint64 id);
+    void retryAll();
+    void discardAll();
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    // Emitted whenever pendingCount() or failed() change
+    void changed();
+
+private:
+    // The same PID on another endpoint is another patient
+    static QString patientKey(int endpointIndex, const QString& pid);
+
+    void startSaves();
+    bool hasFailed(const QString& key) const;
+    void startSave(const Save& save);
+    void onSaveDone(Save save, const MlClient::Error& error);
+
+private:
+    QList<Save> queue_;
+    // By patient key
+    QHash<QString, Save> running_;
+    QList<Save> failed_;
+    qint64 nextId_{1};
+};
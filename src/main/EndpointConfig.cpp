@@ -3,6 +3,7 @@
 
 #include "EndpointConfig.h"
 
+#include "MlPidValidator.h"
 #include "Tools.h"
 #include <QSettings>
 #include <QUuid>
@@ -15,6 +16,16 @@ const auto CfgBaseURL = QStringLiteral("BaseURL");
 const auto CfgApiVersion = QStringLiteral("ApiVersion");
 const auto CfgFields = QStringLiteral("Fields");
 const auto CfgSaveApiKey = QStringLiteral("SaveApiKey");
+const auto CfgHttp2 = QStringLiteral("Http2");
+const auto CfgDiskCache = QStringLiteral("DiskCache");
+const auto CfgDiskCacheTtl = QStringLiteral("DiskCacheTtl");
+const auto CfgPidFormat = QStringLiteral("PidFormat");
+const auto CfgLoadChunkSize = QStringLiteral("LoadChunkSize");
+const auto CfgFieldShardSize = QStringLiteral("FieldShardSize");
+const auto CfgIdTypes = QStringLiteral("IdTypes");
+const auto CfgPidCheckCharacters = QStringLiteral("PidCheckCharacters");
+
+constexpr int DefaultDiskCacheTtlHours = 24;
 
 QString stripTrailingSlash(QString url)
 {
@@ -31,6 +42,11 @@ EndpointConfig::EndpointConfig(const QString& name)
 {
     data_.resize(static_cast<int>(Field::_Count));
     setValue(Field::Name, name);
+    setValue(Field::DiskCacheTtl, DefaultDiskCacheTtlHours);
+    setValue(Field::PidFormat, MlPidValidator::DefaultFormat);
+    setValue(Field::LoadChunkSize, 0);
+    setValue(Field::FieldShardSize, 0);
+    setValue(Field::PidCheckCharacters, false);
 }
 
 void EndpointConfig::load(const QSettings& s)
@@ -52,6 +68,17 @@ void EndpointConfig::load(const QSettings& s)
     if (!saveApiKey.isValid())
         saveApiKey.setValue(true);
     data_[toInt(Field::SaveApiKey)] = saveApiKey.toBool();
+
+    data_[toInt(Field::Http2)] = s.value(CfgHttp2, false).toBool();
+    data_[toInt(Field::DiskCache)] = s.value(CfgDiskCache, false).toBool();
+    data_[toInt(Field::DiskCacheTtl)] = s.value(CfgDiskCacheTtl, DefaultDiskCacheTtlHours).toInt();
+    // Configs from before PID validation send every PID, their IDs may come from another generator
+    data_[toInt(Field::PidFormat)] = s.value(CfgPidFormat).toString();
+    data_[toInt(Field::PidCheckCharacters)] = s.value(CfgPidCheckCharacters, false).toBool();
+    // Tuned while loading, 0 until the first bulk load
+    data_[toInt(Field::LoadChunkSize)] = s.value(CfgLoadChunkSize, 0).toInt();
+    data_[toInt(Field::FieldShardSize)] = s.value(CfgFieldShardSize, 0).toInt();
+    data_[toInt(Field::IdTypes)] = s.value(CfgIdTypes).value<QStringList>();
 }
 
 void EndpointConfig::save(QSettings& s)
@@ -65,6 +92,14 @@ void EndpointConfig::save(QSettings& s)
     s.setValue(CfgApiVersion, data_[toInt(Field::ApiVersion)]);
     s.setValue(CfgFields, data_[toInt(Field::Fields)]);
     s.setValue(CfgSaveApiKey, data_[toInt(Field::SaveApiKey)]);
+    s.setValue(CfgHttp2, data_[toInt(Field::Http2)]);
+    s.setValue(CfgDiskCache, data_[toInt(Field::DiskCache)]);
+    s.setValue(CfgDiskCacheTtl, data_[toInt(Field::DiskCacheTtl)]);
+    s.setValue(CfgPidFormat, data_[toInt(Field::PidFormat)]);
+    s.setValue(CfgLoadChunkSize, data_[toInt(Field::LoadChunkSize)]);
+    s.setValue(CfgFieldShardSize, data_[toInt(Field::FieldShardSize)]);
+    s.setValue(CfgIdTypes, data_[toInt(Field::IdTypes)]);
+    s.setValue(CfgPidCheckCharacters, data_[toInt(Field::PidCheckCharacters)]);
 }
 
 QVariant EndpointConfig::value(EndpointConfig::Field field) const
@@ -19,6 +19,14 @@ public:
         ApiVersion,
         Fields,
         SaveApiKey,
+        Http2,
+        DiskCache,
+        DiskCacheTtl,
+        PidFormat,
+        LoadChunkSize,
+        FieldShardSize,
+        IdTypes,
+        PidCheckCharacters,
         _Count,
     };
 
@@ -45,6 +45,13 @@ void EndpointConfigEditDlg::setup()
     mapper_->addMapping(ui->baseURL, static_cast<int>(EndpointConfig::Field::BaseURL));
     mapper_->addMapping(ui->apiVersion, static_cast<int>(EndpointConfig::Field::ApiVersion));
     mapper_->addMapping(ui->fields, static_cast<int>(EndpointConfig::Field::Fields));
+    mapper_->addMapping(ui->idTypes, static_cast<int>(EndpointConfig::Field::IdTypes));
+    mapper_->addMapping(ui->http2, static_cast<int>(EndpointConfig::Field::Http2));
+    mapper_->addMapping(ui->diskCache, static_cast<int>(EndpointConfig::Field::DiskCache));
+    mapper_->addMapping(ui->diskCacheTtl, static_cast<int>(EndpointConfig::Field::DiskCacheTtl));
+    mapper_->addMapping(ui->pidFormat, static_cast<int>(EndpointConfig::Field::PidFormat));
+    mapper_->addMapping(ui->pidCheckCharacters, static_cast<int>(EndpointConfig::Field::PidCheckCharacters));
+    mapper_->addMapping(ui->fieldShardSize, static_cast<int>(EndpointConfig::Field::FieldShardSize));
 
     connect(ui->configsList->selectionModel(), &QItemSelectionModel::selectionChanged,
             this, &EndpointConfigEditDlg::onSelectionChanged);
@@ -10,6 +10,13 @@ namespace {
 
 const QRegularExpression FieldDelimiterExpr{QStringLiteral("[,;\\s]+")};
 
+// Columns holding a string list, edited as comma separated text
+bool isListColumn(int column)
+{
+    return column == static_cast<int>(EndpointConfig::Field::Fields) ||
+            column == static_cast<int>(EndpointConfig::Field::IdTypes);
+}
+
 } // namespace
 
 EndpointConfigItemDelegate::EndpointConfigItemDelegate(QObject* parent) :
@@ -19,7 +26,7 @@ EndpointConfigItemDelegate::EndpointConfigItemDelegate(QObject* parent) :
 
 void EndpointConfigItemDelegate::setEditorData(QWidget* editor, const QModelIndex& index) const
 {
-    if (index.column() != static_cast<int>(EndpointConfig::Field::Fields))
+    if (!isListColumn(index.column()))
     {
         QStyledItemDelegate::setEditorData(editor, index);
         return;
@@ -35,7 +42,7 @@ void EndpointConfigItemDelegate::setEditorData(QWidget* editor, const QModelInde
 
 void EndpointConfigItemDelegate::setModelData(QWidget* editor, QAbstractItemModel* model, const QModelIndex& index) const
 {
-    if (index.column() != static_cast<int>(EndpointConfig::Field::Fields))
+    if (!isListColumn(index.column()))
     {
         QStyledItemDelegate::setModelData(editor, model, index);
         return;
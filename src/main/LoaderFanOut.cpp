@@ -0,0 +1,188 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "LoaderFanOut.h"
+
+#include "Application.h"
+#include "EndpointConfigModel.h"
+#include "LoaderRun.h"
+#include "MlClientTools.h"
+#include "PasswordStore.h"
+#include "Tools.h"
+#include <QUuid>
+#include <numeric>
+
+namespace {
+
+QUuid endpointUuid(int endpointIndex)
+{
+    const auto model = app()->endpointConfigModel();
+    return model->data(model->index(endpointIndex, toInt(EndpointConfig::Field::Uuid)), Qt::DisplayRole).toUuid();
+}
+
+} // namespace
+
+LoaderFanOut::LoaderFanOut(QList<Source> sources, QStringList pids, QObject* parent) :
+    QObject{parent},
+    sources_{std::move(sources)},
+    pids_{std::move(pids)},
+    patientData_(sources_.size()),
+    doneCounts_(sources_.size())
+{
+}
+
+LoaderFanOut::~LoaderFanOut() = default;
+
+void LoaderFanOut::start()
+{
+    connect(app()->passwordStore(), &PasswordStore::passwordLoaded, this, &LoaderFanOut::onPasswordLoaded);
+
+    for (const auto& source : std::as_const(sources_))
+    {
+        if (!source.apiKey.isEmpty())
+            continue;
+
+        ++pendingKeys_;
+        app()->passwordStore()->loadPassword(endpointUuid(source.endpointIndex), this);
+    }
+
+    if (pendingKeys_ == 0)
+        startRuns();
+}
+
+void LoaderFanOut::onPasswordLoaded(bool result, const QUuid& uuid, const QString& password, void* context)
+{
+    if (context != this)
+        return;
+
+    for (auto& source : sources_)
+    {
+        if (!source.apiKey.isEmpty() || endpointUuid(source.endpointIndex) != uuid)
+            continue;
+
+        --pendingKeys_;
+        if (!result || password.isEmpty())
+        {
+            fail(MlClient::Error{tr("No saved API key for endpoint %1").arg(source.name)});
+            return;
+        }
+        source.apiKey = password;
+    }
+
+    if (pendingKeys_ == 0 && !error_)
+        startRuns();
+}
+
+void LoaderFanOut::startRuns()
+{
+    disconnect(app()->passwordStore(), nullptr, this, nullptr);
+
+    for (qsizetype i = 0; i < sources_.size(); ++i)
+    {
+        const auto& source = sources_[i];
+        const auto pids = sourcePids(source);
+        total_ += static_cast<int>(pids.size());
+
+        auto run = new LoaderRun{source.endpointIndex, source.apiKey, pids, source.fields, this};
+        runs_ << run;
+        ++runsRunning_;
+
+        // The log of one source is hard to tell from the others without its name
+        connect(run, &LoaderRun::logMessage, this, [this, name = source.name](QtMsgType type, const QString& message) {
+            emit logMessage(type, sources_.size() > 1 ? QStringLiteral("%1: %2").arg(name, message) : message);
+        });
+        connect(run, &LoaderRun::progress, this, [this, i](int done, int total) {
+            Q_UNUSED(total)
+            doneCounts_[i] = done;
+            const auto allDone = std::accumulate(doneCounts_.cbegin(), doneCounts_.cend(), 0);
+            emit progress(allDone, total_);
+        });
+        connect(run, &LoaderRun::finished,
+                this, [this, i](const MlClient::Error& error, const MlClient::PatientData& data) {
+            onRunDone(i, error, data);
+        });
+    }
+
+    for (auto run : std::as_const(runs_))
+    {
+        run->start();
+    }
+}
+
+QStringList LoaderFanOut::sourcePids(const Source& source)
+{
+    // Endpoints sharing their PIDs may still differ in PID format, a malformed PID would fail the reads it is part of
+    const auto validator = createPidValidator(source.endpointIndex);
+
+    QStringList pids;
+    pids.reserve(pids_.size());
+    for (const auto& pid : std::as_const(pids_))
+    {
+        // A PID valid only after normalizing is another PID on this endpoint, its records would not merge
+        const auto result = validator.check(pid);
+        if (result.valid && result.pid == pid)
+            pids << pid;
+        else
+            rejectedPids_.insert(pid, tr("Invalid PID for endpoint %1").arg(source.name));
+    }
+
+    if (pids.size() < pids_.size())
+    {
+        emit logMessage(QtWarningMsg, tr("%1 PIDs are skipped for endpoint %2, they do not match its PID format")
+                        .arg(QString::number(pids_.size() - pids.size()), source.name));
+    }
+
+    return pids;
+}
+
+void LoaderFanOut::onRunDone(qsizetype source, const MlClient::Error& error, const MlClient::PatientData& data)
+{
+    --runsRunning_;
+    runs_[source]->deleteLater();
+
+    if (error)
+    {
+        // The other sources run to their end, so their journals are complete for the next attempt
+        if (!error_)
+        {
+            error_ = sources_.size() > 1
+                    ? MlClient::Error{QStringLiteral("%1: %2").arg(sources_[source].name, error.message),
+                                      error.statusCode}
+                    : error;
+        }
+    }
+    else
+    {
+        patientData_[source] = data;
+        for (auto it = error.rejectedPids.cbegin(); it != error.rejectedPids.cend(); ++it)
+        {
+            rejectedPids_.insert(it.key(), sources_.size() > 1
+                                 ? QStringLiteral("%1: %2").arg(sources_[source].name, it.value())
+                                 : it.value());
+        }
+    }
+
+    if (runsRunning_ > 0)
+        return;
+
+    // Once per bulk load, the sizes are tuned with every chunk
+    storeTunedChunkSizes();
+
+    if (error_)
+    {
+        emit finished(error_, {});
+        return;
+    }
+
+    MlClient::Error result;
+    result.rejectedPids = rejectedPids_;
+    emit finished(result, patientData_);
+}
+
+void LoaderFanOut::fail(const MlClient::Error& error)
+{
+    disconnect(app()->passwordStore(), nullptr, this, nullptr);
+
+    error_ = error;
+    emit finished(error_, {});
+}
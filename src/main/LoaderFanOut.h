@@ -0,0 +1,60 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlClient.h"
+#include <QObject>
+
+class LoaderRun;
+
+// Loads the same PIDs from several endpoints at once, each with its own field list, for endpoints sharing their
+// PIDs. Every endpoint has its own scheduler, so the sources load concurrently, each in a checkpointed LoaderRun.
+// Sources without an API key use the key saved for their endpoint. PIDs not matching the PID format of a source are
+// reported as rejected and not loaded from it.
+class LoaderFanOut : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Source
+    {
+        int endpointIndex{-1};
+        QString name{};
+        QString apiKey{};
+        QStringList fields{};
+    };
+
+public:
+    LoaderFanOut(QList<Source> sources, QStringList pids, QObject* parent = {});
+    ~LoaderFanOut() override;
+
+    const QList<Source>& sources() const { return sources_; }
+
+    void start();
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    void progress(int done, int total);
+    // patientData holds the records of each source in the order of the sources, empty on error
+    void finished(const MlClient::Error& error, const QList<MlClient::PatientData>& patientData);
+
+private:
+    void onPasswordLoaded(bool result, const QUuid& uuid, const QString& password, void* context);
+    void startRuns();
+    QStringList sourcePids(const Source& source);
+    void onRunDone(qsizetype source, const MlClient::Error& error, const MlClient::PatientData& data);
+    void fail(const MlClient::Error& error);
+
+private:
+    QList<Source> sources_;
+    QStringList pids_;
+    QList<LoaderRun*> runs_;
+    QList<MlClient::PatientData> patientData_;
+    QList<int> doneCounts_;
+    int pendingKeys_{};
+    int runsRunning_{};
+    int total_{};
+    QHash<QString, QString> rejectedPids_;
+    MlClient::Error error_;
+};
@@ -9,6 +9,7 @@
 #include "DataModel.h"
 #include "EndpointConfigModel.h"
 #include "EndpointSelector.h"
+#include "LoaderFanOut.h"
 #include "MainWindow.h"
 #include "MlClientTools.h"
 #include "Tools.h"
@@ -21,6 +22,7 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QSet>
 
 namespace {
 
@@ -59,10 +61,14 @@ void LoaderPage::initialize(MainWindow* mainWindow)
     connect(mainWindow_, &MainWindow::selectedEndpointChanged, this, &LoaderPage::onSelectedEndpointChanged);
 
     connect(ui->executeBtn, &QAbstractButton::clicked, this, &LoaderPage::onExecuteButtonClicked);
+    connect(ui->existenceOnly, &QAbstractButton::toggled, ui->fields, &QWidget::setDisabled);
+    connect(ui->existenceOnly, &QAbstractButton::toggled, ui->idTypes, &QWidget::setDisabled);
+    connect(ui->existenceOnly, &QAbstractButton::toggled, ui->fanOutEndpoints, &QWidget::setDisabled);
     connect(ui->pasteBtn, &QAbstractButton::clicked, this, &LoaderPage::onPasteButtonClicked);
     connect(ui->loadBtn, &QAbstractButton::clicked, this, &LoaderPage::onLoadButtonClicked);
     connect(ui->saveBtn, &QAbstractButton::clicked, this, &LoaderPage::onSaveButtonClicked);
     connect(ui->clearInputBtn, &QAbstractButton::clicked, this, &LoaderPage::onClearInputButtonClicked);
+    connect(ui->outputTable, &QTableView::doubleClicked, this, &LoaderPage::onOutputTableDoubleClicked);
 
     connect(this, &LoaderPage::inputLoadingDone, this, &LoaderPage::onInputLoadingDone);
     connect(this, &LoaderPage::outputSavingDone, this, &LoaderPage::onOutputSavingDone);
@@ -163,8 +169,12 @@ void LoaderPage::onPidColumSelectorChanged(int index)
     updateUiState();
 }
 
-void LoaderPage::onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData)
+void LoaderPage::onPatientDataLoadingDone(const MlClient::Error& error,
+                                          const QList<MlClient::PatientData>& patientData)
 {
+    auto fanOut = qobject_cast<LoaderFanOut*>(sender());
+    Q_ASSERT(fanOut);
+
     qCDebug(MLR_LOG_CAT) << "Loader Execution: Fetching took" << executionTimer_.elapsed() << "ms";
     executionTimer_.restart();
 
@@ -181,13 +191,47 @@ void LoaderPage::onPatientDataLoadingDone(const MlClient::Error& error, const Ml
     }
     else
     {
-        mergePatientData(patientData);
+        mergePatientData(fanOut->sources(), patientData, error.rejectedPids);
 
         qCDebug(MLR_LOG_CAT) << "Loader Execution: Merging took" << executionTimer_.elapsed() << "ms";
         executionTimer_.restart();
         qCDebug(MLR_LOG_CAT) << "Loader Execution: Stopped";
 
-        mainWindow_->showStatusMessage(tr("Patient data loaded"), 1000);
+        mainWindow_->logMessage(QtInfoMsg, tr("Patient data loaded: %1").arg(runSummary_));
+        mainWindow_->showStatusMessage(tr("Patient data loaded (%1)").arg(runSummary_), 5000);
+    }
+
+    setEnabled(true);
+    updateUiState();
+    fanOut->deleteLater();
+}
+
+void LoaderPage::onPatientExistenceCheckingDone(const MlClient::Error& error, const QStringList& existingPids)
+{
+    qCDebug(MLR_LOG_CAT) << "Loader Execution: Checking took" << executionTimer_.elapsed() << "ms";
+    executionTimer_.restart();
+
+    if (error)
+    {
+        QMessageBox::warning(
+                    this,
+                    tr("Error"),
+                    tr("Error while checking patients: %1").arg(error.message),
+                    QMessageBox::Ok,
+                    QMessageBox::Ok);
+
+        mainWindow_->showStatusMessage(tr("Failed to check patients"), 5000);
+    }
+    else
+    {
+        mergeExistence(existingPids, error.rejectedPids);
+
+        qCDebug(MLR_LOG_CAT) << "Loader Execution: Merging took" << executionTimer_.elapsed() << "ms";
+        executionTimer_.restart();
+        qCDebug(MLR_LOG_CAT) << "Loader Execution: Stopped";
+
+        mainWindow_->logMessage(QtInfoMsg, tr("Patients checked: %1").arg(runSummary_));
+        mainWindow_->showStatusMessage(tr("Patients checked (%1)").arg(runSummary_), 5000);
     }
 
     setEnabled(true);
@@ -200,23 +244,75 @@ void LoaderPage::onExecuteButtonClicked()
     executionTimer_.start();
     qCDebug(MLR_LOG_CAT) << "Loader Execution: Started";
 
+    const bool existenceOnly = ui->existenceOnly->isChecked();
+
     auto fieldList = makeFieldList();
-    if (fieldList.isEmpty())
+    fieldList << makeIdFieldList();
+    if (!existenceOnly && fieldList.isEmpty())
     {
         mainWindow_->showStatusMessage(tr("No fields selected"), 1000);
         return;
     }
 
+    const int invalidPids = normalizePids();
+    const auto pidList = makePidList();
+    if (invalidPids > 0)
+    {
+        const auto message = tr("%1 rows have an invalid PID and are skipped").arg(invalidPids);
+        qCInfo(MLR_LOG_CAT).noquote() << message;
+        mainWindow_->logMessage(QtWarningMsg, message);
+    }
+    if (pidList.isEmpty())
+    {
+        mainWindow_->showStatusMessage(tr("No valid PIDs in input"), 5000);
+        return;
+    }
+
+    const auto validRows = rowPids_.size() - invalidPids;
+    runSummary_ = tr("%1 rows, %2 unique PIDs, dedup ratio %3:1")
+            .arg(QString::number(validRows), QString::number(pidList.size()),
+                 QString::number(double(validRows) / double(pidList.size()), 'f', 2));
+    qCDebug(MLR_LOG_CAT).noquote() << "Loader Execution:" << runSummary_;
+
     setEnabled(false);
-    mainWindow_->showStatusMessage(tr("Loading patient data ..."));
+    if (existenceOnly)
+        mainWindow_->showStatusMessage(tr("Checking patients ..."));
+    else
+        mainWindow_->showStatusMessage(tr("Loading patient data ..."));
 
     qCDebug(MLR_LOG_CAT) << "Loader Execution: Setup took" << executionTimer_.elapsed() << "ms";
     executionTimer_.restart();
 
-    auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
-                                   mainWindow_->endpointSelector()->currentApiKey(),
-                                   mainWindow_, &MainWindow::logMessage);
-    mlClientLoadPatientData(mlClient, makePidList(), fieldList, this, &LoaderPage::onPatientDataLoadingDone);
+    if (existenceOnly)
+    {
+        auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
+                                       mainWindow_->endpointSelector()->currentApiKey(),
+                                       mainWindow_, &MainWindow::logMessage);
+        mlClient->setPriority(MlClient::Priority::Bulk);
+        mlClient->setAdaptiveChunkSize(true);
+        mlClientCheckPatientsExist(mlClient, pidList, this, &LoaderPage::onPatientExistenceCheckingDone);
+        return;
+    }
+
+    const auto selectedEndpoint = mainWindow_->endpointSelector()->selectedEndpoint();
+    const auto model = app()->endpointConfigModel();
+
+    QList<LoaderFanOut::Source> sources;
+    sources << LoaderFanOut::Source{
+               selectedEndpoint,
+               model->data(model->index(selectedEndpoint, toInt(EndpointConfig::Field::Name))).toString(),
+               mainWindow_->endpointSelector()->currentApiKey(),
+               fieldList};
+    sources << makeFanOutSources();
+
+    // Loads are checkpointed, an interrupted load resumes when it is executed again
+    auto fanOut = new LoaderFanOut{sources, pidList, this};
+    connect(fanOut, &LoaderFanOut::logMessage, mainWindow_, &MainWindow::logMessage);
+    connect(fanOut, &LoaderFanOut::progress, this, [this](int done, int total) {
+        mainWindow_->showStatusMessage(tr("Loading patient data ... %1 of %2").arg(done).arg(total));
+    });
+    connect(fanOut, &LoaderFanOut::finished, this, &LoaderPage::onPatientDataLoadingDone);
+    fanOut->start();
 }
 
 void LoaderPage::onPasteButtonClicked()
@@ -300,6 +396,17 @@ void LoaderPage::onInputDataDropped(const QMimeData* mimeData)
     });
 }
 
+void LoaderPage::onOutputTableDoubleClicked(const QModelIndex& index)
+{
+    // Output rows are the input rows, the editor steps through the valid PIDs of the output in its order
+    const auto pid = rowPids_.value(index.row());
+    if (pid.isEmpty())
+        return;
+
+    const auto pids = makePidList();
+    mainWindow_->openEditor(pids, pids.indexOf(pid));
+}
+
 void LoaderPage::readInputFromFile(const QString& fileName)
 {
     Q_ASSERT(mainWindow_);
@@ -370,14 +477,46 @@ void LoaderPage::writeOutput(const QString &fileName)
     });
 }
 
-QStringList LoaderPage::makePidList()
+int LoaderPage::normalizePids()
 {
     const int pidColumn = ui->pidColumnSelector->currentIndex();
 
-    QStringList pids;
+    QStringList inputs;
+    inputs.reserve(inputData_->rowCount());
     for (int i = 0; i < inputData_->rowCount(); ++i)
     {
-        pids << inputData_->data(inputData_->index(i, pidColumn), Qt::DisplayRole).toString();
+        inputs << inputData_->data(inputData_->index(i, pidColumn), Qt::DisplayRole).toString();
+    }
+
+    const auto validator = createPidValidator(mainWindow_->endpointSelector()->selectedEndpoint());
+    const auto results = validator.checkAll(inputs);
+
+    int invalid = 0;
+    rowPids_.clear();
+    rowPids_.reserve(results.size());
+    for (const auto& result : results)
+    {
+        if (!result.valid)
+            ++invalid;
+        rowPids_ << result.pid;
+    }
+
+    return invalid;
+}
+
+// Every PID once, in input order. The merge fans the results out to all rows of a PID.
+QStringList LoaderPage::makePidList()
+{
+    QStringList pids;
+    QSet<QString> seen;
+    seen.reserve(rowPids_.size());
+
+    for (const auto& pid : std::as_const(rowPids_))
+    {
+        if (pid.isEmpty() || seen.contains(pid))
+            continue;
+        seen.insert(pid);
+        pids << pid;
     }
 
     return pids;
@@ -400,75 +539,245 @@ QStringList LoaderPage::makeFieldList()
     return fields;
 }
 
-void LoaderPage::mergePatientData(const MlClient::PatientData& patientData)
+// Selected ID types, requested as ID fields alongside the fields
+QStringList LoaderPage::makeIdFieldList()
 {
-    // make index for patient data
-    QHash<QString, int> pidIndex;
-    for (int i = 0; i < patientData.count(); ++i)
+    QStringList idFields;
+    const auto idTypesSelection = ui->idTypes->selectionModel()->selection().indexes();
+    for (const auto& idx : idTypesSelection)
     {
-        const auto pid = patientData[i]["pid"_l1];
-        pidIndex.insert(pid, i);
+        idFields << MlClient::idField(idx.data(Qt::DisplayRole).toString());
     }
 
-    // get current state
-    const int pidColumn = ui->pidColumnSelector->currentIndex();
-    const auto fields = makeFieldList();
-
-    QList<QStringList> modelData;
+    return idFields;
+}
 
-    // header header row
+QStringList LoaderPage::makeInputHeaderRow()
+{
     QStringList headerRowData;
     for (int col = 0; col < inputData_->columnCount(); ++col)
     {
         headerRowData << inputData_->headerData(col, Qt::Horizontal, Qt::DisplayRole).toString();
     }
-    for (const auto& field : fields)
+    return headerRowData;
+}
+
+QStringList LoaderPage::makeInputRow(int row)
+{
+    QStringList rowData;
+    for (int col = 0; col < inputData_->columnCount(); ++col)
+    {
+        rowData << inputData_->data(inputData_->index(row, col), Qt::DisplayRole).toString();
+    }
+    return rowData;
+}
+
+void LoaderPage::mergePatientData(const QList<LoaderFanOut::Source>& sources,
+                                  const QList<MlClient::PatientData>& patientData,
+                                  const QHash<QString, QString>& rejectedPids)
+{
+    Q_ASSERT(sources.size() == patientData.size());
+
+    // make index for patient data of each source
+    QList<QHash<QString, int>> pidIndexes;
+    for (const auto& data : patientData)
     {
-        headerRowData << field;
+        QHash<QString, int> pidIndex;
+        for (int i = 0; i < data.count(); ++i)
+        {
+            const auto pid = data[i]["pid"_l1];
+            pidIndex.insert(pid, i);
+        }
+        pidIndexes << pidIndex;
     }
+
+    // Columns of several sources are prefixed with the endpoint name, a single source keeps plain names
+    const bool namespaced = sources.size() > 1;
+
+    QList<QStringList> modelData;
+
+    // header header row, ID fields are named after their ID type
+    auto headerRowData = makeInputHeaderRow();
+    for (const auto& source : sources)
+    {
+        for (const auto& field : source.fields)
+        {
+            const auto idType = MlClient::idTypeOf(field);
+            const auto column = idType.isEmpty() ? field : idType;
+            headerRowData << (namespaced ? QStringLiteral("%1.%2").arg(source.name, column) : column);
+        }
+    }
+    headerRowData << tr("PID status");
     modelData << headerRowData;
 
-    // merge and add patient records
+    // merge and add patient records, rows without a record are kept with empty fields and flagged
+    int notFound = 0;
     for (int row = 0; row < inputData_->rowCount(); ++row)
     {
-        const auto rowPid = inputData_->data(inputData_->index(row, pidColumn), Qt::DisplayRole).toString();
+        const auto rowPid = rowPids_.value(row);
 
-        QStringList rowData;
+        auto rowData = makeInputRow(row);
 
-        for (int col = 0; col < inputData_->columnCount(); ++col)
+        QStringList missingIn;
+        for (qsizetype i = 0; i < sources.size(); ++i)
         {
-            rowData << inputData_->data(inputData_->index(row, col), Qt::DisplayRole).toString();
+            const auto& fields = sources[i].fields;
+            const auto& pidIndex = pidIndexes[i];
+
+            const auto patientDataIndex = rowPid.isEmpty() ? pidIndex.end() : pidIndex.find(rowPid);
+            if (patientDataIndex == pidIndex.end())
+            {
+                for (int f = 0; f < fields.count(); ++f)
+                    rowData << QString{};
+                missingIn << sources[i].name;
+            }
+            else
+            {
+                const auto& patientRecord = patientData[i][*patientDataIndex];
+                for (const auto& field : fields)
+                {
+                    rowData << patientRecord[field];
+                }
+            }
         }
 
-        const auto patientDataIndex = pidIndex.find(rowPid);
-        if (patientDataIndex == pidIndex.end())
+        if (rowPid.isEmpty())
+        {
+            rowData << tr("invalid");
+        }
+        else if (rejectedPids.contains(rowPid))
+        {
+            rowData << tr("rejected: %1").arg(rejectedPids.value(rowPid));
+        }
+        else if (missingIn.size() == sources.size())
         {
-            qCWarning(MLR_LOG_CAT) << "PID" << rowPid << "not found in ML result";
+            rowData << tr("not found");
+            ++notFound;
+        }
+        else if (!missingIn.isEmpty())
+        {
+            rowData << tr("not found in %1").arg(missingIn.join(QStringLiteral(", ")));
+        }
+        else
+        {
+            rowData << QString{};
+        }
+
+        modelData << rowData;
+    }
+
+    if (notFound > 0)
+        qCWarning(MLR_LOG_CAT) << notFound << "rows with a PID not found in ML result";
 
-            for (int i = 0; i < fields.count(); ++i)
-                rowData << QString{};
+    outputData_->setFirstRowHeader(true);
+    outputData_->setModelData(modelData, false);
+}
+
+void LoaderPage::mergeExistence(const QStringList& existingPids, const QHash<QString, QString>& rejectedPids)
+{
+    const QSet<QString> existing{existingPids.begin(), existingPids.end()};
+
+    QList<QStringList> modelData;
+
+    auto headerRowData = makeInputHeaderRow();
+    headerRowData << tr("exists");
+    modelData << headerRowData;
 
+    const auto found = tr("found");
+    const auto missing = tr("missing");
+    const auto invalid = tr("invalid");
+    const auto rejected = tr("rejected");
+
+    for (int row = 0; row < inputData_->rowCount(); ++row)
+    {
+        const auto rowPid = rowPids_.value(row);
+
+        auto rowData = makeInputRow(row);
+        if (rowPid.isEmpty())
+            rowData << invalid;
+        else if (rejectedPids.contains(rowPid))
+            rowData << rejected;
+        else
+            rowData << (existing.contains(rowPid) ? found : missing);
+
+        modelData << rowData;
+    }
+
+    outputData_->setFirstRowHeader(true);
+    outputData_->setModelData(modelData, false);
+}
+
+QList<LoaderFanOut::Source> LoaderPage::makeFanOutSources()
+{
+    QList<LoaderFanOut::Source> sources;
+
+    for (int i = 0; i < ui->fanOutEndpoints->topLevelItemCount(); ++i)
+    {
+        const auto item = ui->fanOutEndpoints->topLevelItem(i);
+        if (item->checkState(0) == Qt::Unchecked)
             continue;
+
+        QStringList fields;
+        for (int f = 0; f < item->childCount(); ++f)
+        {
+            if (item->child(f)->checkState(0) == Qt::Checked)
+                fields << item->child(f)->text(0);
         }
 
-        const auto& patientRecord = patientData[*patientDataIndex];
+        // The API key is taken from the keychain
+        sources << LoaderFanOut::Source{item->data(0, Qt::UserRole).toInt(), item->text(0), {}, fields};
+    }
+
+    return sources;
+}
+
+void LoaderPage::reloadFanOutEndpoints(int endpointIndex)
+{
+    ui->fanOutEndpoints->clear();
+
+    const auto model = app()->endpointConfigModel();
+    for (int row = 0; row < model->rowCount() && endpointIndex != -1; ++row)
+    {
+        if (row == endpointIndex)
+            continue;
+
+        const auto name = model->data(model->index(row, toInt(EndpointConfig::Field::Name))).toString();
+        const auto fields = model->data(model->index(row, toInt(EndpointConfig::Field::Fields))).toStringList();
+        const auto keySaved = model->data(model->index(row, toInt(EndpointConfig::Field::SaveApiKey))).toBool();
+
+        // Children follow the check state of the endpoint, they pick its fields
+        auto item = new QTreeWidgetItem{ui->fanOutEndpoints, {name}};
+        item->setData(0, Qt::UserRole, row);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable | Qt::ItemIsAutoTristate);
+        item->setCheckState(0, Qt::Unchecked);
+
         for (const auto& field : fields)
         {
-            rowData << patientRecord[field];
+            auto fieldItem = new QTreeWidgetItem{item, {field}};
+            fieldItem->setFlags(fieldItem->flags() | Qt::ItemIsUserCheckable);
+            fieldItem->setCheckState(0, Qt::Unchecked);
         }
 
-        modelData << rowData;
+        if (!keySaved)
+        {
+            item->setDisabled(true);
+            item->setToolTip(0, tr("Save the API key of this endpoint to load from it"));
+        }
     }
 
-    outputData_->setFirstRowHeader(true);
-    outputData_->setModelData(modelData, false);
+    const bool hasEndpoints = ui->fanOutEndpoints->topLevelItemCount() > 0;
+    ui->fanOutEndpoints->setVisible(hasEndpoints);
+    ui->fanOutEndpointsLabel->setVisible(hasEndpoints);
 }
 
 void LoaderPage::reloadFieldList(int endpointIndex)
 {
+    reloadFanOutEndpoints(endpointIndex);
+
     if (endpointIndex == -1)
     {
         ui->fields->setItems({});
+        ui->idTypes->setItems({});
         return;
     }
 
@@ -477,4 +786,11 @@ void LoaderPage::reloadFieldList(int endpointIndex)
     ui->fields->setItems(model->data(modelIndex, Qt::DisplayRole).toStringList());
 
     ui->fields->selectAll();
+
+    // Extra ID types are only loaded when picked
+    const auto idTypesIndex = model->index(endpointIndex, toInt(EndpointConfig::Field::IdTypes));
+    const auto idTypes = model->data(idTypesIndex, Qt::DisplayRole).toStringList();
+    ui->idTypes->setItems(idTypes);
+    ui->idTypes->setVisible(!idTypes.isEmpty());
+    ui->idTypesLabel->setVisible(!idTypes.isEmpty());
 }
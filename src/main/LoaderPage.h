@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "LoaderFanOut.h"
 #include "MlClient.h"
 #include <QElapsedTimer>
 #include <QWidget>
@@ -40,10 +41,12 @@ private slots:
     void onOutputSavingDone(bool result);
     void onInputDataChanged();
     void onPidColumSelectorChanged(int index);
-    void onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData);
+    void onPatientDataLoadingDone(const MlClient::Error& error, const QList<MlClient::PatientData>& patientData);
+    void onPatientExistenceCheckingDone(const MlClient::Error& error, const QStringList& existingPids);
     void onEndpointConfigChanged();
     void onSelectedEndpointChanged(int index);
     void onInputDataDropped(const QMimeData* mimeData);
+    void onOutputTableDoubleClicked(const QModelIndex& index);
 
 private:
     void loadWidgetState();
@@ -53,10 +56,18 @@ private:
     void readInputFromClipboard();
     bool readInput(QIODevice& input);
     void writeOutput(const QString& fileName);
+    int normalizePids();
     QStringList makePidList();
     QStringList makeFieldList();
-    void mergePatientData(const MlClient::PatientData& patientData);
+    QStringList makeIdFieldList();
+    QStringList makeInputHeaderRow();
+    QStringList makeInputRow(int row);
+    QList<LoaderFanOut::Source> makeFanOutSources();
+    void mergePatientData(const QList<LoaderFanOut::Source>& sources, const QList<MlClient::PatientData>& patientData,
+                          const QHash<QString, QString>& rejectedPids);
+    void mergeExistence(const QStringList& existingPids, const QHash<QString, QString>& rejectedPids);
     void reloadFieldList(int endpointIndex);
+    void reloadFanOutEndpoints(int endpointIndex);
 
 private:
     Ui::LoaderPage* ui;
@@ -64,6 +75,9 @@ private:
     DataModel* inputData_{};
     DataModel* outputData_{};
     QElapsedTimer executionTimer_;
+    // Normalized PID per input row, empty for rows with an invalid PID
+    QStringList rowPids_;
+    QString runSummary_;
 
     Q_DISABLE_COPY_MOVE(LoaderPage)
 };
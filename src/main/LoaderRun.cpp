@@ -0,0 +1,206 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "LoaderRun.h"
+
+#include "Application.h"
+#include "CacheManager.h"
+#include "EndpointConfigModel.h"
+#include "MlClientTools.h"
+#include "MlDiskCache.h"
+#include "MlRecordCache.h"
+#include "Tools.h"
+#include <QCryptographicHash>
+#include <QSet>
+#include <QUuid>
+
+LoaderRun::LoaderRun(int endpointIndex, QString apiKey, QStringList pids, QStringList fields, QObject* parent) :
+    QObject{parent},
+    endpointIndex_{endpointIndex},
+    apiKey_{std::move(apiKey)},
+    pids_{std::move(pids)},
+    fields_{std::move(fields)}
+{
+}
+
+LoaderRun::~LoaderRun() = default;
+
+void LoaderRun::start()
+{
+    const auto model = app()->endpointConfigModel();
+    const auto uuid = model->data(model->index(endpointIndex_, toInt(EndpointConfig::Field::Uuid)),
+                                  Qt::DisplayRole).toUuid();
+
+    journal_ = app()->cacheManager()->openJournal(uuid, runId());
+    if (journal_)
+    {
+        resume();
+    }
+    else
+    {
+        emit logMessage(QtWarningMsg, tr("No load journal available, an interrupted bulk load can not be resumed"));
+        remaining_ = pids_;
+    }
+
+    if (remaining_.isEmpty())
+    {
+        // Everything was loaded before the interruption, deliver asynchronously like a load from the server
+        QMetaObject::invokeMethod(this, &LoaderRun::finishIfDone, Qt::QueuedConnection);
+        return;
+    }
+
+    while (segmentsRunning_ < SegmentsInFlight && pos_ < remaining_.size())
+    {
+        startNextSegment();
+    }
+}
+
+QString LoaderRun::runId() const
+{
+    // The same PIDs and fields form the same run, no matter in which order
+    auto pids = pids_;
+    pids.sort();
+    auto fields = fields_;
+    fields.sort();
+
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    hash.addData(pids.join(QLatin1Char('\n')).toUtf8());
+    hash.addData(QByteArrayView{"\0", 1});
+    hash.addData(fields.join(QLatin1Char('\n')).toUtf8());
+    return QString::fromLatin1(hash.result().toHex().left(32));
+}
+
+void LoaderRun::resume()
+{
+    for (const auto& pid : std::as_const(pids_))
+    {
+        MlDiskCache::Record entry;
+        if (!journal_->read(pid, entry))
+        {
+            remaining_ << pid;
+            continue;
+        }
+
+        ++done_;
+
+        // An entry without fields is a PID the server did not return
+        if (entry.fields.isEmpty())
+            continue;
+
+        MlClient::PatientRecord record;
+        record.insert(MlClient::ID_TYPE, pid);
+        for (auto it = entry.fields.cbegin(); it != entry.fields.cend(); ++it)
+        {
+            if (it->present)
+                record.insert(it.key(), it->value);
+        }
+        patientData_ << record;
+    }
+
+    if (done_ > 0)
+    {
+        emit logMessage(QtInfoMsg, tr("Resuming interrupted load, %1 of %2 patients were loaded before")
+                        .arg(QString::number(done_), QString::number(pids_.size())));
+        emit progress(done_, static_cast<int>(pids_.size()));
+    }
+}
+
+void LoaderRun::startNextSegment()
+{
+    const auto segment = remaining_.mid(pos_, SegmentSize);
+    pos_ += segment.size();
+    ++segmentsRunning_;
+
+    auto mlClient = createMlClientIntern(endpointIndex_, apiKey_);
+    mlClient->setPriority(MlClient::Priority::Bulk);
+    mlClient->setAdaptiveChunkSize(true);
+
+    connect(mlClient, &MlClient::logMessage, this, &LoaderRun::logMessage);
+    connect(mlClient, &MlClient::patientDataLoadingDone,
+            this, [this, mlClient, segment](const MlClient::Error& error, const MlClient::PatientData& data) {
+        mlClient->deleteWhenIdle();
+        onSegmentDone(segment, error, data);
+    });
+
+    mlClient->loadPatientData(segment, fields_);
+}
+
+void LoaderRun::onSegmentDone(const QStringList& pids, const MlClient::Error& error,
+                              const MlClient::PatientData& data)
+{
+    --segmentsRunning_;
+
+    if (error)
+    {
+        // Segments still running are checkpointed, so a retry resumes after them
+        if (!error_)
+            error_ = error;
+    }
+    else
+    {
+        checkpoint(pids, error, data);
+
+        patientData_ << data;
+        rejectedPids_.insert(error.rejectedPids);
+        done_ += static_cast<int>(pids.size());
+        emit progress(done_, static_cast<int>(pids_.size()));
+    }
+
+    if (!error_ && pos_ < remaining_.size())
+        startNextSegment();
+
+    finishIfDone();
+}
+
+void LoaderRun::checkpoint(const QStringList& pids, const MlClient::Error& error, const MlClient::PatientData& data)
+{
+    if (!journal_)
+        return;
+
+    const auto now = MlRecordCache::now();
+
+    QSet<QString> returned;
+    for (const auto& record : data)
+    {
+        const auto pid = record.value(MlClient::ID_TYPE);
+        returned.insert(pid);
+
+        MlDiskCache::Record entry;
+        entry.seenMs = now;
+        for (const auto& field : std::as_const(fields_))
+        {
+            const auto it = record.find(field);
+            const bool present = it != record.end();
+            entry.fields.insert(field, MlDiskCache::Value{present ? it.value() : QString{}, present, now});
+        }
+        journal_->write(pid, entry);
+    }
+
+    // Missing PIDs are done too, rejected ones are tried again on resume
+    for (const auto& pid : pids)
+    {
+        if (!returned.contains(pid) && !error.rejectedPids.contains(pid))
+            journal_->write(pid, MlDiskCache::Record{now, {}});
+    }
+}
+
+void LoaderRun::finishIfDone()
+{
+    if (segmentsRunning_ > 0)
+        return;
+
+    if (error_)
+    {
+        emit logMessage(QtWarningMsg, tr("Load interrupted after %1 of %2 patients, it resumes when started again")
+                        .arg(QString::number(done_), QString::number(pids_.size())));
+        emit finished(error_, {});
+        return;
+    }
+
+    CacheManager::removeJournal(journal_);
+    journal_.reset();
+
+    MlClient::Error result;
+    result.rejectedPids = rejectedPids_;
+    emit finished(result, patientData_);
+}
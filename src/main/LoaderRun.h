@@ -0,0 +1,55 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlClient.h"
+#include <QObject>
+#include <QSharedPointer>
+
+class MlDiskCache;
+
+// A bulk load of the Loader. The PIDs are loaded in segments and every finished segment is written to an encrypted
+// journal. A run interrupted by a crash or a lost connection is resumed from its journal when the same PIDs and fields
+// are loaded again, only the PIDs not done yet are fetched. The journal is removed when the run completes.
+class LoaderRun : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int SegmentSize = 2000;
+    static constexpr int SegmentsInFlight = 2;
+
+public:
+    LoaderRun(int endpointIndex, QString apiKey, QStringList pids, QStringList fields, QObject* parent = {});
+    ~LoaderRun() override;
+
+    void start();
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    void progress(int done, int total);
+    void finished(const MlClient::Error& error, const MlClient::PatientData& patientData);
+
+private:
+    QString runId() const;
+    void resume();
+    void startNextSegment();
+    void onSegmentDone(const QStringList& pids, const MlClient::Error& error, const MlClient::PatientData& data);
+    void checkpoint(const QStringList& pids, const MlClient::Error& error, const MlClient::PatientData& data);
+    void finishIfDone();
+
+private:
+    int endpointIndex_;
+    QString apiKey_;
+    QStringList pids_;
+    QStringList fields_;
+    QSharedPointer<MlDiskCache> journal_;
+    QStringList remaining_;
+    qsizetype pos_{};
+    int segmentsRunning_{};
+    int done_{};
+    MlClient::PatientData patientData_;
+    QHash<QString, QString> rejectedPids_;
+    MlClient::Error error_;
+};
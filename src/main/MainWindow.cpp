@@ -5,11 +5,14 @@
 #include "ui_MainWindow.h"
 
 #include "Application.h"
+#include "CacheManager.h"
+#include "EditorPage.h"
 #include "EndpointConfigEditDlg.h"
 #include "EndpointConfigModel.h"
 #include "Tools.h"
 #include "Version.h"
 #include "UserSettings.h"
+#include <QCloseEvent>
 #include <QDateTime>
 #include <QDebug>
 #include <QFile>
@@ -65,12 +68,14 @@ bool MainWindow::initialize()
     ui->functionStack->setTabIcon(toInt(Page::Editor), QIcon::fromTheme(QStringLiteral("document-edit")));
 
     ui->actionEndpointConfigEdit->setIcon(QIcon::fromTheme(QStringLiteral("configure")));
+    ui->actionPurgeCache->setIcon(QIcon::fromTheme(QStringLiteral("edit-clear-all")));
     ui->actionQuit->setIcon(QIcon::fromTheme(QStringLiteral("application-exit")));
     ui->actionShowLoaderPage->setIcon(QIcon::fromTheme(QStringLiteral("download")));
     ui->actionShowQueryPage->setIcon(QIcon::fromTheme(QStringLiteral("system-search")));
     ui->actionShowEditorPage->setIcon(QIcon::fromTheme(QStringLiteral("document-edit")));
 
     connect(ui->actionEndpointConfigEdit, &QAction::triggered, this, &MainWindow::onActionEndpointConfigEdit);
+    connect(ui->actionPurgeCache, &QAction::triggered, this, &MainWindow::onActionPurgeCacheTriggered);
     connect(ui->actionQuit, &QAction::triggered, this, &MainWindow::onActionQuitTriggerd);
     connect(ui->actionAbout, &QAction::triggered, this, &MainWindow::onActionAboutTriggerd);
 
@@ -115,6 +120,37 @@ void MainWindow::openPage(Page page, const QVariant& openData)
     }
 }
 
+void MainWindow::openEditor(const QStringList& pids, qsizetype index)
+{
+    ui->actionShowEditorPage->trigger();
+    ui->editorPage->startEditing(pids, index);
+}
+
+void MainWindow::closeEvent(QCloseEvent* event)
+{
+    // Also reached through QApplication::quit(), which closes all windows first
+    if (confirmQuit())
+        event->accept();
+    else
+        event->ignore();
+}
+
+bool MainWindow::confirmQuit()
+{
+    // Saves of the editor are committed in the background, quitting would drop them
+    const int pendingSaves = ui->editorPage->pendingSaveCount();
+    if (pendingSaves == 0)
+        return true;
+
+    const auto answer = QMessageBox::question(
+                this,
+                tr("Quit"),
+                tr("%1 saves are not committed yet and will be lost. Quit anyway?").arg(pendingSaves),
+                QMessageBox::Yes | QMessageBox::No,
+                QMessageBox::No);
+    return answer == QMessageBox::Yes;
+}
+
 void MainWindow::logMessage(QtMsgType type, const QString& message)
 {
     QString string;
@@ -199,6 +235,18 @@ void MainWindow::onActionEndpointConfigEdit()
     emit endpointConfigChanged();
 }
 
+void MainWindow::onActionPurgeCacheTriggered()
+{
+    const auto answer = QMessageBox::question(this, tr("Purge Record Cache"),
+                                              tr("Delete all cached patient data from memory and disk?"));
+    if (answer != QMessageBox::Yes)
+        return;
+
+    app()->cacheManager()->purge();
+
+    showStatusMessage(tr("Record cache purged"), 3000);
+}
+
 void MainWindow::onActionQuitTriggerd()
 {
     QApplication::quit();
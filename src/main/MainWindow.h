@@ -34,6 +34,11 @@ public:
 
     void showStatusMessage(const QString& message, int timeout = 0);
     void openPage(Page page, const QVariant& openData);
+    // Opens pids[index] in the editor, which can step through the whole list
+    void openEditor(const QStringList& pids, qsizetype index);
+
+protected:
+    void closeEvent(QCloseEvent* event) override;
 
 public slots:
     void logMessage(QtMsgType type, const QString& message);
@@ -44,6 +49,7 @@ signals:
 
 private slots:
     void onActionEndpointConfigEdit();
+    void onActionPurgeCacheTriggered();
     void onActionQuitTriggerd();
     void onActionAboutTriggerd();
     void onShowLoaderPageTriggered();
@@ -56,6 +62,7 @@ private:
     void loadMainWindowState();
     void saveMainWindowState();
     void updateUi();
+    bool confirmQuit();
 
 private:
     Ui::MainWindow* ui;
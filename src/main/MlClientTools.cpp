@@ -4,11 +4,59 @@
 #include "MlClientTools.h"
 
 #include "Application.h"
+#include "CacheManager.h"
 #include "EndpointConfigModel.h"
+#include "HttpReplayTransport.h"
 #include "MlClient.h"
 #include "Tools.h"
+#include <QUuid>
 #include <QVersionNumber>
 
+namespace {
+
+// Tuned chunk sizes by endpoint UUID, not stored yet
+QHash<QUuid, int>& tunedChunkSizes()
+{
+    static QHash<QUuid, int> sizes;
+    return sizes;
+}
+
+} // namespace
+
+void storeTunedChunkSizes()
+{
+    auto& sizes = tunedChunkSizes();
+    if (sizes.isEmpty())
+        return;
+
+    const auto model = app()->endpointConfigModel();
+    if (!model->isWriteable())
+    {
+        sizes.clear();
+        return;
+    }
+
+    bool changed = false;
+    for (int row = 0; row < model->rowCount(); ++row)
+    {
+        const auto uuid = model->data(model->index(row, toInt(EndpointConfig::Field::Uuid)), Qt::DisplayRole).toUuid();
+        const auto it = sizes.constFind(uuid);
+        if (it == sizes.cend())
+            continue;
+
+        const auto index = model->index(row, toInt(EndpointConfig::Field::LoadChunkSize));
+        if (model->data(index, Qt::DisplayRole).toInt() == it.value())
+            continue;
+
+        model->setData(index, it.value());
+        changed = true;
+    }
+    sizes.clear();
+
+    if (changed)
+        model->save();
+}
+
 MlClient* createMlClientIntern(int endpointIndex, const QString& apiKey)
 {
     const auto model = app()->endpointConfigModel();
@@ -20,12 +68,62 @@ MlClient* createMlClientIntern(int endpointIndex, const QString& apiKey)
                 model->index(endpointIndex, toInt(EndpointConfig::Field::ApiVersion)),
                 Qt::DisplayRole).toString();
 
-    return new MlClient{baseUrl, QVersionNumber::fromString(apiVersion), apiKey};
+    const auto http2 = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::Http2)),
+                Qt::DisplayRole).toBool();
+    const auto uuid = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::Uuid)),
+                Qt::DisplayRole).toUuid();
+    const auto loadChunkSize = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::LoadChunkSize)),
+                Qt::DisplayRole).toInt();
+    const auto fieldShardSize = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::FieldShardSize)),
+                Qt::DisplayRole).toInt();
+
+    auto mlClient = new MlClient{baseUrl, QVersionNumber::fromString(apiVersion), apiKey};
+    mlClient->setHttp2Enabled(http2);
+    mlClient->setDiskCache(app()->cacheManager()->diskCache(uuid));
+    mlClient->setTunedChunkSize(loadChunkSize);
+    mlClient->setFieldShardSize(fieldShardSize);
+
+    // Keep the tuned chunk size as the starting point for the next session, it is stored when a bulk load ends
+    QObject::connect(mlClient, &MlClient::chunkSizeTuned, mlClient, [uuid](int size) {
+        tunedChunkSizes().insert(uuid, size);
+    });
+
+    if (auto cassette = app()->cassette())
+    {
+        if (app()->isReplaying())
+            mlClient->setTransport(new HttpReplayTransport{cassette, app()->replayTimeScale()});
+        else
+            mlClient->setRecorder(cassette);
+    }
+
+    return mlClient;
 }
 
 void deleteSenderMlClient(QObject* sender)
 {
     auto mlClient = qobject_cast<MlClient*>(sender);
     Q_ASSERT(mlClient);
-    mlClient->deleteLater();
+    mlClient->deleteWhenIdle();
+}
+
+MlPidValidator createPidValidator(int endpointIndex)
+{
+    const auto model = app()->endpointConfigModel();
+
+    const auto format = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::PidFormat)),
+                Qt::DisplayRole).toString();
+    const auto checkCharacters = model->data(
+                model->index(endpointIndex, toInt(EndpointConfig::Field::PidCheckCharacters)),
+                Qt::DisplayRole).toBool();
+
+    MlPidValidator validator{format, checkCharacters};
+    if (!validator.isFormatValid())
+        qCWarning(MLR_LOG_CAT) << "Invalid PID format" << format << ":" << validator.formatError();
+
+    return validator;
 }
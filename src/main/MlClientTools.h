@@ -4,10 +4,14 @@
 #pragma once
 
 #include "MlClient.h"
+#include "MlPidValidator.h"
 #include <QObject>
 
 MlClient* createMlClientIntern(int endpointIndex, const QString& apiKey);
 void deleteSenderMlClient(QObject* sender);
+MlPidValidator createPidValidator(int endpointIndex);
+// Writes the chunk sizes tuned by adaptive loads to the endpoint configs, saving them once
+void storeTunedChunkSizes();
 
 template<typename Callback>
 MlClient* createMlClient(int endpointIndex, const QString& apiKey,
@@ -30,6 +34,16 @@ inline void mlClientLoadPatientData(MlClient* mlClient, const QStringList& pidLi
     mlClient->loadPatientData(pidList, fieldList);
 }
 
+template<typename Callback>
+inline void mlClientCheckPatientsExist(MlClient* mlClient, const QStringList& pidList,
+                                       const typename QtPrivate::FunctionPointer<Callback>::Object* target,
+                                       Callback callback)
+{
+    QObject::connect(mlClient, &MlClient::patientExistenceCheckingDone, target, callback);
+
+    mlClient->checkPatientsExist(pidList);
+}
+
 template<typename Callback>
 inline void mlClientQueryPatientData(MlClient* mlClient, const QHash<QString, QString>& patientData, bool sureness,
                                      const typename QtPrivate::FunctionPointer<Callback>::Object* target,
@@ -40,6 +54,16 @@ inline void mlClientQueryPatientData(MlClient* mlClient, const QHash<QString, QS
     mlClient->queryPatientData(patientData, sureness);
 }
 
+template<typename Callback>
+inline void mlClientQueryPatients(MlClient* mlClient, const QList<QHash<QString, QString>>& patients,
+                                  const typename QtPrivate::FunctionPointer<Callback>::Object* target,
+                                  Callback callback)
+{
+    QObject::connect(mlClient, &MlClient::patientsQueringDone, target, callback);
+
+    mlClient->queryPatients(patients);
+}
+
 template<typename Callback>
 inline void mlClientEditPatientData(MlClient* mlClient, const QString& pid, const QHash<QString, QString>& patientData,
                                     const typename QtPrivate::FunctionPointer<Callback>::Object* target,
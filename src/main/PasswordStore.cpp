@@ -31,10 +31,11 @@ bool PasswordStore::loadPassword(const QUuid& uuid, void* context)
         Q_ASSERT(rj);
 
         auto ok = rj->error() == QKeychain::NoError;
-        if (!ok && rj->error() != QKeychain::EntryNotFound)
+        auto notFound = rj->error() == QKeychain::EntryNotFound;
+        if (!ok && !notFound)
             qCWarning(MLR_LOG_CAT) << "Read password exited with error:" << rj->error();
 
-        emit passwordLoaded(ok, uuid, QString::fromUtf8(rj->binaryData()), context);
+        emit passwordLoaded(ok, uuid, QString::fromUtf8(rj->binaryData()), context, notFound);
     });
 
     job->start();
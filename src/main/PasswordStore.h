@@ -18,7 +18,9 @@ public:
     bool removePassword(const QUuid& uuid, void* context = {});
 
 signals:
-    void passwordLoaded(bool result, const QUuid& uuid, const QString& passwd, void* context = {});
+    // notFound tells a missing entry apart from a keychain that could not be read (locked, access denied)
+    void passwordLoaded(bool result, const QUuid& uuid, const QString& passwd, void* context = {},
+                        bool notFound = false);
     void passwordSaved(bool result, const QUuid& uuid, void* context = {});
     void passwordRemoved(bool result, const QUuid& uuid, void* context = {});
 };
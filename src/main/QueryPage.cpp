@@ -5,6 +5,7 @@
 #include "ui_QueryPage.h"
 
 #include "Application.h"
+#include "CsvReader.h"
 #include "DataModel.h"
 #include "EndpointConfig.h"
 #include "EndpointConfigModel.h"
@@ -14,8 +15,12 @@
 #include "Tools.h"
 #include "UserSettings.h"
 #include <QClipboard>
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QMenu>
+#include <QSet>
 
 namespace {
 
@@ -26,7 +31,9 @@ const auto CfgPageSplitter= QStringLiteral("Window/QueryPage/Splitter");
 QueryPage::QueryPage(QWidget *parent) :
     QWidget{parent},
     ui{new Ui::QueryPage{}},
-    possibleMatchesModel_{new DataModel{this}}
+    possibleMatchesModel_{new DataModel{this}},
+    bulkInput_{new DataModel{this}},
+    bulkResultsModel_{new DataModel{this}}
 {
     ui->setupUi(this);
 }
@@ -44,16 +51,20 @@ void QueryPage::initialize(MainWindow* mainWindow)
 
     ui->queryResultPane->setVisible(false);
     ui->possibleMatchesPane->setVisible(false);
+    ui->bulkResultPane->setVisible(false);
 
     ui->splitter->setCollapsible(0, false);
 
     ui->possibleMatches->setModel(possibleMatchesModel_);
     ui->possibleMatches->setContextMenuPolicy(Qt::CustomContextMenu);
+    ui->bulkResults->setModel(bulkResultsModel_);
 
     connect(mainWindow_, &MainWindow::endpointConfigChanged, this, &QueryPage::onEndpointConfigChanged);
     connect(mainWindow_, &MainWindow::selectedEndpointChanged, this, &QueryPage::onSelectedEndpointChanged);
 
     connect(ui->executeBtn, &QAbstractButton::clicked, this, &QueryPage::onExecuteButtonClicked);
+    connect(ui->bulkQueryBtn, &QAbstractButton::clicked, this, &QueryPage::onBulkQueryBtnClicked);
+    connect(ui->saveBulkResultsBtn, &QAbstractButton::clicked, this, &QueryPage::onSaveBulkResultsBtnClicked);
     connect(ui->editPatientBtn, &QAbstractButton::clicked, this, &QueryPage::onEditPatientBtnClicked);
     connect(ui->copyPidBtn, &QAbstractButton::clicked, this, &QueryPage::onCopyPidBtnClicked);
 
@@ -85,6 +96,7 @@ void QueryPage::updateUiState()
     bool endpointSelected = mainWindow_->endpointSelector()->selectedEndpoint() != -1;
 
     ui->executeBtn->setEnabled(endpointSelected);
+    ui->bulkQueryBtn->setEnabled(endpointSelected);
 }
 
 void QueryPage::execute(bool sureness)
@@ -98,6 +110,59 @@ void QueryPage::execute(bool sureness)
                              this, &QueryPage::onPatientDataQueringDone);
 }
 
+QList<QHash<QString, QString>> QueryPage::makeBulkPatients()
+{
+    const auto model = app()->endpointConfigModel();
+    const auto modelIndex = model->index(mainWindow_->endpointSelector()->selectedEndpoint(),
+                                         toInt(EndpointConfig::Field::Fields));
+    const auto fields = model->data(modelIndex, Qt::DisplayRole).toStringList();
+
+    // The first row names the field of each column, columns of other names are not sent
+    QHash<int, QString> columnFields;
+    QStringList ignored;
+    for (int column = 0; column < bulkInput_->columnCount(); ++column)
+    {
+        const auto header = bulkInput_->headerData(column, Qt::Horizontal, Qt::DisplayRole).toString().trimmed();
+        if (fields.contains(header))
+            columnFields.insert(column, header);
+        else
+            ignored << header;
+    }
+
+    if (!ignored.isEmpty())
+    {
+        mainWindow_->logMessage(QtWarningMsg, tr("Bulk query ignores columns which are no endpoint fields: %1")
+                                .arg(ignored.join(QStringLiteral(", "))));
+    }
+
+    QList<QHash<QString, QString>> patients;
+    patients.reserve(bulkInput_->rowCount());
+    bulkPatientRows_.clear();
+    int empty = 0;
+    for (int row = 0; row < bulkInput_->rowCount(); ++row)
+    {
+        QHash<QString, QString> patient;
+        for (auto it = columnFields.cbegin(); it != columnFields.cend(); ++it)
+        {
+            const auto value = bulkInput_->data(bulkInput_->index(row, it.key()), Qt::DisplayRole).toString();
+            if (!value.isEmpty())
+                patient.insert(it.value(), value);
+        }
+        if (patient.isEmpty())
+        {
+            ++empty;
+            continue;
+        }
+        patients << patient;
+        bulkPatientRows_ << row;
+    }
+
+    if (empty > 0)
+        mainWindow_->logMessage(QtWarningMsg, tr("%1 rows have no identity data and are skipped").arg(empty));
+
+    return patients;
+}
+
 void QueryPage::reloadDynamicForm(int endpointIndex)
 {
     QList<DynamicForm::Field> dynamicFields;
@@ -156,6 +221,75 @@ void QueryPage::onExecuteButtonClicked()
     execute(false);
 }
 
+void QueryPage::onBulkQueryBtnClicked()
+{
+    UserSettings s;
+
+    auto fileName = QFileDialog::getOpenFileName(
+                this,
+                tr("Open identity data file (csv list)"),
+                s.stringValue(CfgLastAccessedDirectory),
+                tr("CSV Files (*.csv);;All Files (*.*)")
+                );
+
+    if (fileName.isEmpty())
+        return;
+
+    QFileInfo fi{fileName};
+    s.setValue(CfgLastAccessedDirectory, fi.absolutePath());
+
+    QFile input{fileName};
+    CsvReader csvReader{};
+    if (!input.open(QFile::ReadOnly) || !csvReader.read(input, bulkInput_))
+    {
+        mainWindow_->showStatusMessage(tr("Failed to read identity data file"), 5000);
+        return;
+    }
+    bulkInput_->setFirstRowHeader(true);
+
+    const auto patients = makeBulkPatients();
+    if (patients.isEmpty())
+    {
+        mainWindow_->showStatusMessage(tr("No patients in identity data file"), 5000);
+        return;
+    }
+
+    setEnabled(false);
+    mainWindow_->showStatusMessage(tr("Querying %1 patients ...").arg(patients.size()));
+
+    auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
+                                   mainWindow_->endpointSelector()->currentApiKey(),
+                                   mainWindow_, &MainWindow::logMessage);
+    mlClient->setPriority(MlClient::Priority::Bulk);
+    connect(mlClient, &MlClient::patientsQueringProgress, this, &QueryPage::onPatientsQueringProgress);
+    mlClientQueryPatients(mlClient, patients, this, &QueryPage::onPatientsQueringDone);
+}
+
+void QueryPage::onSaveBulkResultsBtnClicked()
+{
+    UserSettings s;
+
+    auto fileName = QFileDialog::getSaveFileName(
+                this,
+                tr("Save bulk query results (csv list)"),
+                s.stringValue(CfgLastAccessedDirectory),
+                tr("CSV Files (*.csv);;All Files (*.*)")
+                );
+
+    if (fileName.isEmpty())
+        return;
+
+    QFileInfo fi{fileName};
+    s.setValue(CfgLastAccessedDirectory, fi.absolutePath());
+
+    QFile output{fileName};
+    CsvReader csvReader{};
+    if (output.open(QFile::WriteOnly | QFile::Truncate) && csvReader.write(output, true, bulkResultsModel_))
+        mainWindow_->showStatusMessage(tr("Bulk query results saved"), 1000);
+    else
+        mainWindow_->showStatusMessage(tr("Failed to save bulk query results"), 5000);
+}
+
 void QueryPage::onEditPatientBtnClicked()
 {
     mainWindow_->openPage(MainWindow::Page::Editor, ui->patientPid->text());
@@ -219,6 +353,7 @@ void QueryPage::onPatientDataQueringDone(const MlClient::Error& error, const MlC
 
             ui->queryResultPane->setVisible(true);
             ui->possibleMatchesPane->setVisible(false);
+            ui->bulkResultPane->setVisible(false);
         }
         else
         {
@@ -226,6 +361,8 @@ void QueryPage::onPatientDataQueringDone(const MlClient::Error& error, const MlC
 
             ui->queryResultPane->setVisible(false);
             ui->possibleMatchesPane->setVisible(true);
+            ui->bulkResultPane->setVisible(false);
+            ui->createAnywayBtn->setVisible(true);
 
             auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
                                            mainWindow_->endpointSelector()->currentApiKey(),
@@ -245,6 +382,109 @@ void QueryPage::onPatientDataQueringDone(const MlClient::Error& error, const MlC
     deleteSenderMlClient(sender());
 }
 
+void QueryPage::onPatientsQueringProgress(int done, int total)
+{
+    mainWindow_->showStatusMessage(tr("Querying patients ... %1 of %2").arg(done).arg(total));
+}
+
+void QueryPage::onPatientsQueringDone(const MlClient::Error& error, const QList<MlClient::QueryResult>& results)
+{
+    if (error)
+    {
+        QMessageBox::warning(
+                    this,
+                    tr("Error"),
+                    tr("Error while quering patients: %1").arg(error.message),
+                    QMessageBox::Ok,
+                    QMessageBox::Ok);
+
+        mainWindow_->showStatusMessage(tr("Failed to query patients"), 5000);
+    }
+
+    // A stopped query still has results for the patients queried before
+    if (!results.isEmpty())
+    {
+        const auto& input = bulkInput_->modelData();
+
+        const auto inputColumns = bulkInput_->columnCount();
+
+        QStringList headerRow = input.value(0);
+        headerRow << MlClient::ID_TYPE << tr("tentative") << tr("possible matches") << tr("error");
+
+        QList<QStringList> resultData;
+        resultData << headerRow;
+
+        // All possible matches are loaded together, a patient may be a possible match of several rows
+        QStringList matchPids;
+        QSet<QString> seenMatches;
+        int created = 0;
+        int conflicts = 0;
+        int failed = 0;
+        for (qsizetype i = 0; i < results.size(); ++i)
+        {
+            const auto& result = results[i];
+
+            // The first row of the input is the header
+            auto row = input.value(bulkPatientRows_.value(i) + 1);
+            row.resize(inputColumns);
+            row << result.pid << (result.tentative ? tr("yes") : QString{})
+                << result.possibleMatchPids.join(QLatin1Char(' ')) << result.error;
+            resultData << row;
+
+            if (!result.error.isEmpty())
+                ++failed;
+            else if (!result.pid.isEmpty())
+                ++created;
+            else
+                ++conflicts;
+
+            for (const auto& pid : result.possibleMatchPids)
+            {
+                if (!seenMatches.contains(pid))
+                {
+                    seenMatches.insert(pid);
+                    matchPids << pid;
+                }
+            }
+        }
+
+        bulkResultsModel_->setFirstRowHeader(true);
+        bulkResultsModel_->setModelData(resultData, false);
+
+        const auto summary = tr("%1 patients: %2 with PID, %3 with possible matches, %4 failed")
+                .arg(QString::number(results.size()), QString::number(created),
+                     QString::number(conflicts), QString::number(failed));
+        ui->bulkSummary->setText(summary);
+        mainWindow_->logMessage(QtInfoMsg, tr("Bulk query done: %1").arg(summary));
+
+        ui->queryResultPane->setVisible(false);
+        ui->bulkResultPane->setVisible(true);
+        ui->createAnywayBtn->setVisible(false);
+        ui->possibleMatchesPane->setVisible(!matchPids.isEmpty());
+
+        if (!matchPids.isEmpty())
+        {
+            ui->possibleMatches->setEnabled(false);
+
+            auto mlClient = createMlClient(mainWindow_->endpointSelector()->selectedEndpoint(),
+                                           mainWindow_->endpointSelector()->currentApiKey(),
+                                           mainWindow_, &MainWindow::logMessage);
+            mlClient->setPriority(MlClient::Priority::Bulk);
+            mlClientLoadPatientData(mlClient, matchPids, mainWindow_->endpointSelector()->currentFieldList(),
+                                    this, &QueryPage::onPatientDataLoadingDone);
+        }
+
+        fixSplitterSizes();
+
+        if (!error)
+            mainWindow_->showStatusMessage(tr("Patients queried"), 1000);
+    }
+
+    setEnabled(true);
+    updateUiState();
+    deleteSenderMlClient(sender());
+}
+
 void QueryPage::onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData)
 {
     if (error)
@@ -309,8 +549,12 @@ void QueryPage::onPossibleMatchesDoubleClicked(const QModelIndex& index)
     if (pidColumn == -1)
         return;
 
-    const auto pidIndex = possibleMatchesModel_->index(index.row(), pidColumn);
-    const auto pid = possibleMatchesModel_->data(pidIndex, Qt::DisplayRole);
+    // All possible matches can be stepped through in the editor
+    QStringList pids;
+    for (int row = 0; row < possibleMatchesModel_->rowCount(); ++row)
+    {
+        pids << possibleMatchesModel_->data(possibleMatchesModel_->index(row, pidColumn), Qt::DisplayRole).toString();
+    }
 
-    mainWindow_->openPage(MainWindow::Page::Editor, pid);
+    mainWindow_->openEditor(pids, index.row());
 }
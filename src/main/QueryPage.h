@@ -28,11 +28,15 @@ protected:
 
 private slots:
     void onExecuteButtonClicked();
+    void onBulkQueryBtnClicked();
+    void onSaveBulkResultsBtnClicked();
     void onEditPatientBtnClicked();
     void onCopyPidBtnClicked();
     void onCreateAnywayBtnClicked();
     void onCustomMenuRequested(const QPoint& position);
     void onPatientDataQueringDone(const MlClient::Error& error, const MlClient::QueryResult& result);
+    void onPatientsQueringProgress(int done, int total);
+    void onPatientsQueringDone(const MlClient::Error& error, const QList<MlClient::QueryResult>& results);
     void onPatientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& patientData);
     void onPossibleMatchesDoubleClicked(const QModelIndex& index);
     void onEndpointConfigChanged();
@@ -45,11 +49,16 @@ private:
     void execute(bool sureness);
     void reloadDynamicForm(int endpointIndex);
     void fixSplitterSizes();
+    QList<QHash<QString, QString>> makeBulkPatients();
 
 private:
     Ui::QueryPage* ui;
     MainWindow* mainWindow_{};
     DataModel* possibleMatchesModel_;
+    DataModel* bulkInput_;
+    DataModel* bulkResultsModel_;
+    // The input row of each queried patient, rows without data are not sent
+    QList<int> bulkPatientRows_{};
 
     Q_DISABLE_COPY_MOVE(QueryPage)
 };
@@ -3,22 +3,91 @@
 
 #include "HttpBody.h"
 
+#include <QIODevice>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QUrl>
+#include <cstring>
+
+namespace {
+
+class GeneratorDevice : public QIODevice
+{
+public:
+    GeneratorDevice(qint64 size, HttpBody::Generator generator, QObject* parent) :
+        QIODevice{parent},
+        size_{size},
+        generator_{std::move(generator)}
+    {
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override { return size_; }
+    qint64 bytesAvailable() const override { return (size_ - produced_) + QIODevice::bytesAvailable(); }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        qint64 written = 0;
+
+        while (written < maxSize)
+        {
+            if (chunkPos_ >= chunk_.size())
+            {
+                if (exhausted_)
+                    break;
+
+                chunk_ = generator_(nextChunk_++);
+                chunkPos_ = 0;
+
+                if (chunk_.isEmpty())
+                {
+                    exhausted_ = true;
+                    break;
+                }
+            }
+
+            const auto count = qMin(maxSize - written, static_cast<qint64>(chunk_.size() - chunkPos_));
+            std::memcpy(data + written, chunk_.constData() + chunkPos_, static_cast<size_t>(count));
+            chunkPos_ += count;
+            written += count;
+        }
+
+        produced_ += written;
+        return written;
+    }
+
+    qint64 writeData(const char* data, qint64 maxSize) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(maxSize)
+        return -1;
+    }
+
+private:
+    qint64 size_;
+    HttpBody::Generator generator_;
+    QByteArray chunk_{};
+    qint64 chunkPos_{};
+    int nextChunk_{};
+    qint64 produced_{};
+    bool exhausted_{};
+};
+
+} // namespace
 
 HttpBody HttpBody::fromJson(const QJsonArray& json)
 {
     QJsonDocument doc{json};
-    return {QStringLiteral("application/json"), doc.toJson()};
+    return {QStringLiteral("application/json"), doc.toJson(QJsonDocument::Compact)};
 }
 
 HttpBody HttpBody::fromJson(const QJsonObject& json)
 {
     QJsonDocument doc{json};
-    return {QStringLiteral("application/json"), doc.toJson()};
+    return {QStringLiteral("application/json"), doc.toJson(QJsonDocument::Compact)};
 }
 
 HttpBody HttpBody::jsonObjectFromHash(const QHash<QString, QString>& data)
@@ -45,6 +114,14 @@ HttpBody HttpBody::urlEncodedFromHash(const QHash<QString, QString>& data)
     return {QStringLiteral("application/x-www-form-urlencoded"), buffer};
 }
 
+HttpBody HttpBody::fromGenerator(QString contentType, qint64 size, Generator generator)
+{
+    HttpBody body{std::move(contentType), {}};
+    body.size_ = size;
+    body.generator_ = std::move(generator);
+    return body;
+}
+
 HttpBody::HttpBody()
 {
 }
@@ -55,6 +132,15 @@ HttpBody::HttpBody(QString contentType, QByteArray binaryData) :
 {
 }
 
+QIODevice* HttpBody::createDevice(QObject* parent) const
+{
+    Q_ASSERT(isStreamed());
+
+    auto device = new GeneratorDevice{size_, generator_, parent};
+    device->open(QIODevice::ReadOnly);
+    return device;
+}
+
 QJsonDocument HttpBody::toJson() const
 {
     return QJsonDocument::fromJson(binaryData_);
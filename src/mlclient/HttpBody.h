@@ -3,19 +3,28 @@
 
 #pragma once
 
+#include <QByteArray>
 #include <QString>
+#include <functional>
 
+class QIODevice;
 class QJsonArray;
 class QJsonDocument;
 class QJsonObject;
+class QObject;
 
 class HttpBody
 {
+public:
+    // Produces the body chunk by chunk. Called with increasing chunk index, an empty chunk marks the end of the body.
+    using Generator = std::function<QByteArray(int chunkIndex)>;
+
 public:
     static HttpBody fromJson(const QJsonArray& json);
     static HttpBody fromJson(const QJsonObject& json);
     static HttpBody jsonObjectFromHash(const QHash<QString, QString>& data);
     static HttpBody urlEncodedFromHash(const QHash<QString, QString>& data);
+    static HttpBody fromGenerator(QString contentType, qint64 size, Generator generator);
 
 public:
     HttpBody();
@@ -29,6 +38,11 @@ public:
 
     bool isNull() const { return contentType_.isEmpty(); }
 
+    // Streamed bodies are not held in memory but produced while they are sent. The size must be known in advance.
+    bool isStreamed() const { return static_cast<bool>(generator_); }
+    qint64 size() const { return isStreamed() ? size_ : binaryData_.size(); }
+    QIODevice* createDevice(QObject* parent = {}) const;
+
     QJsonDocument toJson() const;
     QJsonArray toJsonArray() const;
     QJsonObject toJsonObject() const;
@@ -36,4 +50,6 @@ public:
 private:
     QString contentType_;
     QByteArray binaryData_;
+    qint64 size_{};
+    Generator generator_{};
 };
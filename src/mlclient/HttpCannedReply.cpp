@@ -0,0 +1,137 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "HttpCannedReply.h"
+
+#include <QTimer>
+#include <cstring>
+
+namespace {
+
+// Same mapping QNetworkAccessManager applies to HTTP status codes
+QNetworkReply::NetworkError errorForStatus(int statusCode)
+{
+    if (statusCode < 400)
+        return QNetworkReply::NoError;
+
+    switch (statusCode)
+    {
+        case 400: return QNetworkReply::ProtocolInvalidOperationError;
+        case 401: return QNetworkReply::AuthenticationRequiredError;
+        case 403: return QNetworkReply::ContentAccessDenied;
+        case 404: return QNetworkReply::ContentNotFoundError;
+        case 405: return QNetworkReply::ContentOperationNotPermittedError;
+        case 409: return QNetworkReply::ContentConflictError;
+        case 410: return QNetworkReply::ContentGoneError;
+        case 500: return QNetworkReply::InternalServerError;
+        case 501: return QNetworkReply::OperationNotImplementedError;
+        case 503: return QNetworkReply::ServiceUnavailableError;
+        default: return statusCode < 500 ? QNetworkReply::UnknownContentError : QNetworkReply::UnknownServerError;
+    }
+}
+
+} // namespace
+
+HttpCannedReply::HttpCannedReply(const QNetworkRequest& request, QNetworkAccessManager::Operation operation,
+                                 int statusCode, const QByteArray& contentType, const QByteArray& body,
+                                 QObject* parent) :
+    QNetworkReply{parent},
+    data_{body}
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(operation);
+
+    if (statusCode > 0)
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, statusCode);
+    if (!contentType.isEmpty())
+        setHeader(QNetworkRequest::ContentTypeHeader, QString::fromLatin1(contentType));
+    setHeader(QNetworkRequest::ContentLengthHeader, static_cast<qint64>(data_.size()));
+
+    const auto error = errorForStatus(statusCode);
+    if (error != QNetworkReply::NoError)
+        setError(error, QString::fromUtf8(body));
+
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+QNetworkAccessManager::Operation HttpCannedReply::operationFor(HttpRequest::Method method)
+{
+    switch (method)
+    {
+        using enum HttpRequest::Method;
+
+        case GET:
+            return QNetworkAccessManager::GetOperation;
+        case POST:
+            return QNetworkAccessManager::PostOperation;
+        case PUT:
+            return QNetworkAccessManager::PutOperation;
+        case DELETE:
+            return QNetworkAccessManager::DeleteOperation;
+    }
+
+    Q_UNREACHABLE();
+}
+
+void HttpCannedReply::setNetworkError(QNetworkReply::NetworkError error, const QString& errorString)
+{
+    setError(error, errorString);
+}
+
+void HttpCannedReply::finishAfter(int delayMs)
+{
+    QTimer::singleShot(delayMs, this, &HttpCannedReply::deliver);
+}
+
+void HttpCannedReply::abort()
+{
+    if (isFinished())
+        return;
+
+    delivered_ = true;
+    data_.clear();
+    setError(QNetworkReply::OperationCanceledError, tr("Operation canceled"));
+    setFinished(true);
+    emit errorOccurred(QNetworkReply::OperationCanceledError);
+    emit finished();
+}
+
+qint64 HttpCannedReply::bytesAvailable() const
+{
+    return (delivered_ ? data_.size() - readPos_ : 0) + QIODevice::bytesAvailable();
+}
+
+qint64 HttpCannedReply::readData(char* data, qint64 maxSize)
+{
+    if (!delivered_)
+        return 0;
+
+    const auto count = qMin(maxSize, static_cast<qint64>(data_.size()) - readPos_);
+    if (count <= 0)
+        return isFinished() ? -1 : 0;
+
+    std::memcpy(data, data_.constData() + readPos_, static_cast<size_t>(count));
+    readPos_ += count;
+    return count;
+}
+
+void HttpCannedReply::deliver()
+{
+    if (delivered_)
+        return;
+
+    delivered_ = true;
+
+    if (!data_.isEmpty())
+    {
+        emit downloadProgress(data_.size(), data_.size());
+        emit readyRead();
+    }
+
+    if (error() != QNetworkReply::NoError)
+        emit errorOccurred(error());
+
+    setFinished(true);
+    emit finished();
+}
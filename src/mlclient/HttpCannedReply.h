@@ -0,0 +1,41 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpRequest.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+
+// Reply carrying a complete, already known response. Used by transports which do not talk to a real server.
+class HttpCannedReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    HttpCannedReply(const QNetworkRequest& request, QNetworkAccessManager::Operation operation,
+                    int statusCode, const QByteArray& contentType, const QByteArray& body, QObject* parent = {});
+
+    static QNetworkAccessManager::Operation operationFor(HttpRequest::Method method);
+
+    // For failures below HTTP level, e.g. a refused connection
+    void setNetworkError(QNetworkReply::NetworkError error, const QString& errorString);
+
+    // Delivers the response to the reader after the delay, 0 delivers it with the next event loop iteration
+    void finishAfter(int delayMs);
+
+    void abort() override;
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+
+private:
+    void deliver();
+
+private:
+    QByteArray data_;
+    qint64 readPos_{};
+    bool delivered_{};
+};
@@ -0,0 +1,181 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "HttpCassette.h"
+
+#include "Tools.h"
+
+namespace {
+
+constexpr quint32 CassetteMagic = 0x4d4c4358; // "MLCX"
+constexpr quint16 CassetteVersion = 1;
+constexpr auto StreamVersion = QDataStream::Qt_6_0;
+
+QByteArray serialize(const HttpCassette::Exchange& exchange)
+{
+    QByteArray data;
+    QDataStream out{&data, QIODevice::WriteOnly};
+    out.setVersion(StreamVersion);
+
+    out << static_cast<quint8>(exchange.method) << exchange.url << exchange.requestBody
+        << static_cast<qint32>(exchange.statusCode) << static_cast<qint32>(exchange.networkError)
+        << exchange.errorString << exchange.contentType << exchange.responseBody
+        << exchange.startedMs << exchange.durationMs;
+
+    return qCompress(data);
+}
+
+bool deserialize(const QByteArray& block, HttpCassette::Exchange& exchange)
+{
+    const auto data = qUncompress(block);
+    if (data.isEmpty())
+        return false;
+
+    QDataStream in{data};
+    in.setVersion(StreamVersion);
+
+    quint8 method{};
+    qint32 statusCode{};
+    qint32 networkError{};
+
+    in >> method >> exchange.url >> exchange.requestBody >> statusCode >> networkError
+       >> exchange.errorString >> exchange.contentType >> exchange.responseBody
+       >> exchange.startedMs >> exchange.durationMs;
+
+    if (in.status() != QDataStream::Ok || method > static_cast<quint8>(HttpRequest::Method::DELETE))
+        return false;
+
+    exchange.method = static_cast<HttpRequest::Method>(method);
+    exchange.statusCode = statusCode;
+    exchange.networkError = static_cast<QNetworkReply::NetworkError>(networkError);
+    return true;
+}
+
+} // namespace
+
+HttpCassette::HttpCassette()
+{
+    clock_.start();
+}
+
+HttpCassette::~HttpCassette() = default;
+
+bool HttpCassette::load(const QString& fileName)
+{
+    QFile file{fileName};
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        errorString_ = file.errorString();
+        return false;
+    }
+
+    QDataStream in{&file};
+    in.setVersion(StreamVersion);
+
+    quint32 magic{};
+    quint16 version{};
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != CassetteMagic)
+    {
+        errorString_ = QObject::tr("%1 is not a cassette file").arg(fileName);
+        return false;
+    }
+    if (version > CassetteVersion)
+    {
+        errorString_ = QObject::tr("Unsupported cassette version %1").arg(version);
+        return false;
+    }
+
+    QList<Exchange> exchanges;
+    while (!in.atEnd())
+    {
+        QByteArray block;
+        in >> block;
+
+        Exchange exchange;
+        if (in.status() != QDataStream::Ok || !deserialize(block, exchange))
+        {
+            // A recording session which crashed may leave a truncated last block
+            if (in.atEnd())
+                break;
+
+            errorString_ = QObject::tr("Corrupt exchange #%1 in %2").arg(exchanges.size() + 1).arg(fileName);
+            return false;
+        }
+        exchanges << exchange;
+    }
+
+    exchanges_ = std::move(exchanges);
+    rewind();
+    return true;
+}
+
+bool HttpCassette::startRecording(const QString& fileName)
+{
+    if (file_.isOpen())
+        file_.close();
+
+    file_.setFileName(fileName);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errorString_ = file_.errorString();
+        return false;
+    }
+
+    stream_.setDevice(&file_);
+    stream_.setVersion(StreamVersion);
+    stream_ << CassetteMagic << CassetteVersion;
+
+    exchanges_.clear();
+    pending_.clear();
+    clock_.restart();
+    return file_.flush();
+}
+
+void HttpCassette::record(const Exchange& exchange)
+{
+    // Only streamed to the file, a long recording would otherwise keep every response body in memory
+    if (!file_.isOpen())
+        return;
+
+    stream_ << serialize(exchange);
+    if (!file_.flush())
+        qCWarning(MLC_LOG_CAT) << "Failed to write cassette" << file_.fileName() << ":" << file_.errorString();
+}
+
+const HttpCassette::Exchange* HttpCassette::take(HttpRequest::Method method, const QUrl& url,
+                                                 const QByteArray& requestBody)
+{
+    auto it = pending_.find(keyOf(method, url));
+    if (it == pending_.end() || it->isEmpty())
+        return nullptr;
+
+    auto& candidates = *it;
+    qsizetype pos = 0;
+    for (qsizetype i = 0; i < candidates.size(); ++i)
+    {
+        if (exchanges_[candidates[i]].requestBody == requestBody)
+        {
+            pos = i;
+            break;
+        }
+    }
+
+    const auto index = candidates.takeAt(pos);
+    return &exchanges_[index];
+}
+
+void HttpCassette::rewind()
+{
+    pending_.clear();
+    for (qsizetype i = 0; i < exchanges_.size(); ++i)
+    {
+        const auto& exchange = exchanges_[i];
+        pending_[keyOf(exchange.method, exchange.url)] << i;
+    }
+}
+
+QString HttpCassette::keyOf(HttpRequest::Method method, const QUrl& url)
+{
+    return QString::number(static_cast<int>(method)) + QLatin1Char(' ') + url.toString(QUrl::FullyEncoded);
+}
@@ -0,0 +1,68 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpRequest.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QNetworkReply>
+
+// Recorded HTTP exchanges of a session. While recording every finished exchange is appended to the cassette file
+// immediately, so a crashed session still leaves a usable cassette. Request headers (and thereby the API key) are
+// not recorded.
+//
+// File format: a QDataStream with magic and version, followed by one qCompress'ed block per exchange.
+class HttpCassette
+{
+public:
+    struct Exchange
+    {
+        HttpRequest::Method method{};
+        QUrl url{};
+        QByteArray requestBody{};
+        int statusCode{};
+        QNetworkReply::NetworkError networkError{};
+        QString errorString{};
+        QByteArray contentType{};
+        QByteArray responseBody{};
+        qint64 startedMs{};
+        qint64 durationMs{};
+    };
+
+public:
+    HttpCassette();
+    ~HttpCassette();
+
+    bool load(const QString& fileName);
+    bool startRecording(const QString& fileName);
+    QString errorString() const { return errorString_; }
+
+    bool isRecording() const { return file_.isOpen(); }
+    qint64 elapsed() const { return clock_.elapsed(); }
+    void record(const Exchange& exchange);
+
+    // The exchanges of a loaded cassette, recorded exchanges are only written to the file
+    const QList<Exchange>& exchanges() const { return exchanges_; }
+
+    // Takes the next not yet replayed exchange for method and URL. If there are several candidates the one with an
+    // identical request body is preferred, otherwise they are taken in recording order.
+    const Exchange* take(HttpRequest::Method method, const QUrl& url, const QByteArray& requestBody);
+    void rewind();
+
+private:
+    static QString keyOf(HttpRequest::Method method, const QUrl& url);
+
+private:
+    QList<Exchange> exchanges_;
+    QHash<QString, QList<qsizetype>> pending_;
+    QFile file_;
+    QDataStream stream_;
+    QElapsedTimer clock_;
+    QString errorString_;
+
+    Q_DISABLE_COPY_MOVE(HttpCassette)
+};
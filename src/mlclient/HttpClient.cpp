@@ -3,25 +3,15 @@
 
 #include "HttpClient.h"
 
-#include "HttpUserDelegate.h"
+#include "HttpCassette.h"
+#include "HttpNetworkTransport.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "Tools.h"
-#include <QAuthenticator>
 #include <QNetworkReply>
 
 namespace {
 
-void checkTLSSupport(const HttpRequest& request)
-{
-    if (request.url().scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) && !QSslSocket::supportsSsl())
-    {
-        qCCritical(MLC_LOG_CAT) << "No TLS Support. Required TLS library version version:" <<
-            QSslSocket::sslLibraryBuildVersionString() <<
-            "TLS library version available:" << QSslSocket::sslLibraryVersionString();
-    }
-}
-
 void setHeaders(QNetworkRequest& request, const QHash<QString, QString>& headers)
 {
     for (auto it = headers.begin(); it != headers.end(); ++it)
@@ -30,83 +20,114 @@ void setHeaders(QNetworkRequest& request, const QHash<QString, QString>& headers
     }
 }
 
+QString originOf(const QUrl& url)
+{
+    const auto scheme = url.scheme().toLower();
+    const int defaultPort = scheme == "https"_l1 ? 443 : 80;
+    return "%1://%2:%3"_l1.arg(scheme, url.host(), QString::number(url.port(defaultPort)));
+}
+
 } // namespace
 
 HttpClient::HttpClient(HttpUserDelegate* delegate, QObject* parent) :
     QObject{parent},
-    delegate_{delegate}
+    transport_{new HttpNetworkTransport{delegate, this}}
 {
-    connect(&qnam_, &QNetworkAccessManager::authenticationRequired, this, &HttpClient::onAuthenticationRequired);
-    connect(&qnam_, &QNetworkAccessManager::sslErrors, this, &HttpClient::onSslErrors);
 }
 
-HttpResponse* HttpClient::startRequest(const HttpRequest& request)
+void HttpClient::setTransport(HttpTransport* transport)
 {
-    checkTLSSupport(request);
+    Q_ASSERT(transport);
 
-    switch (request.method())
-    {
-        using enum HttpRequest::Method;
+    if (transport_ && transport_->parent() == this)
+        transport_->deleteLater();
 
-        case GET:
-        {
-            QNetworkRequest req{request.url()};
-            setHeaders(req, request.headers());
-            return new HttpResponse{qnam_.get(req), this};
-            break;
-        }
+    transport_ = transport;
+    if (!transport_->parent())
+        transport_->setParent(this);
+}
 
-        case POST:
-        {
-            QNetworkRequest req{request.url()};
-            setHeaders(req, request.headers());
-            if (!request.body().isNull())
-                req.setHeader(QNetworkRequest::ContentTypeHeader, request.body().contentType());
-            return new HttpResponse{qnam_.post(req, request.body().binaryData()), this};
-            break;
-        }
+HttpResponse* HttpClient::startRequest(const HttpRequest& request)
+{
+    auto req = makeNetworkRequest(request);
+    if (!request.body().isNull())
+        req.setHeader(QNetworkRequest::ContentTypeHeader, request.body().contentType());
+
+    auto response = trackResponse(originOf(request.url()), transport_->send(request.method(), req, request.body()));
+    if (recorder_)
+        recordExchange(request, response);
+    return response;
+}
 
-        case PUT:
-        {
-            QNetworkRequest req{request.url()};
-            setHeaders(req, request.headers());
-            if (!request.body().isNull())
-                req.setHeader(QNetworkRequest::ContentTypeHeader, request.body().contentType());
-            return new HttpResponse{qnam_.put(req, request.body().binaryData()), this};
-            break;
-        }
+QNetworkRequest HttpClient::makeNetworkRequest(const HttpRequest& request) const
+{
+    QNetworkRequest req{request.url()};
+    setHeaders(req, request.headers());
 
-        case DELETE:
-        {
-            QNetworkRequest req{request.url()};
-            setHeaders(req, request.headers());
-            return new HttpResponse{qnam_.deleteResource(req), this};
-            break;
-        }
+    // Qt already negotiates HTTP/2 via ALPN on TLS connections. Enabling it also allows the upgrade mechanism on
+    // cleartext connections. If the server does not support it the connection silently falls back to HTTP/1.1.
+    if (http2Enabled_)
+    {
+        req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+        req.setAttribute(QNetworkRequest::Http2CleartextAllowedAttribute, true);
     }
 
-    Q_UNREACHABLE();
+    return req;
 }
 
-
-void HttpClient::onAuthenticationRequired(QNetworkReply* reply, QAuthenticator* authenticator)
+HttpResponse* HttpClient::trackResponse(const QString& origin, QNetworkReply* reply)
 {
-    Q_UNUSED(authenticator)
+    auto& stats = connectionStats_[origin];
+    ++stats.requests;
+    ++stats.inFlight;
+    stats.peakInFlight = qMax(stats.peakInFlight, stats.inFlight);
+
+    connect(reply, &QNetworkReply::finished, this, [this, origin, reply]()
+    {
+        auto& s = connectionStats_[origin];
+        --s.inFlight;
 
-    reply->abort();
+        if (reply->error() != QNetworkReply::NoError &&
+                !reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).isValid())
+            return;
+
+        if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool())
+        {
+            ++s.http2Requests;
+            s.protocol = QStringLiteral("h2");
+        }
+        else if (s.protocol.isEmpty())
+        {
+            s.protocol = QStringLiteral("http/1.1");
+        }
+    });
+
+    return new HttpResponse{reply, this};
 }
 
-void HttpClient::onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors)
+void HttpClient::recordExchange(const HttpRequest& request, HttpResponse* response)
 {
-    QString errorString;
-    for (const QSslError &error : errors) {
-        if (!errorString.isEmpty())
-            errorString += QLatin1Char('\n');
-        errorString += error.errorString();
-    }
-
-    if (delegate_->askRecoverableError(tr("SSL Errors"), tr("One or more SSL errors has occurred:\n%1").arg(errorString)))
+    HttpCassette::Exchange exchange;
+    exchange.method = request.method();
+    exchange.url = request.url();
+    // Streamed bodies are produced while sending and not kept, they are recorded without content
+    if (!request.body().isStreamed())
+        exchange.requestBody = request.body().binaryData();
+    exchange.startedMs = recorder_->elapsed();
+
+    auto recorder = recorder_;
+    connect(response, &HttpResponse::finished, this,
+            [recorder, response, exchange](QNetworkReply::NetworkError error, int statusCode) mutable
     {
-        reply->ignoreSslErrors();
-    }
+        exchange.statusCode = statusCode;
+        if (statusCode <= 0)
+        {
+            exchange.networkError = error;
+            exchange.errorString = response->networkErrorString();
+        }
+        exchange.contentType = response->body().contentType().toUtf8();
+        exchange.responseBody = response->body().binaryData();
+        exchange.durationMs = recorder->elapsed() - exchange.startedMs;
+        recorder->record(exchange);
+    });
 }
@@ -4,29 +4,57 @@
 #pragma once
 
 #include "HttpBody.h"
+#include <QNetworkRequest>
 #include <QObject>
-#include <QNetworkAccessManager>
 
+class HttpCassette;
 class HttpUserDelegate;
 class HttpRequest;
 class HttpResponse;
+class HttpTransport;
+class QNetworkReply;
 
 class HttpClient : public QObject
 {
     Q_OBJECT
 
 public:
+    // Statistics per origin (scheme://host:port). With HTTP/2 all requests to an origin are multiplexed as streams
+    // over a single connection, with HTTP/1.1 QNetworkAccessManager spreads them over up to six connections.
+    struct ConnectionStats
+    {
+        QString protocol{};
+        int requests{};
+        int http2Requests{};
+        int inFlight{};
+        int peakInFlight{};
+    };
 
 public:
     HttpClient(HttpUserDelegate* delegate, QObject* parent = {});
 
+    HttpTransport* transport() const { return transport_; }
+    void setTransport(HttpTransport* transport);
+
+    bool http2Enabled() const { return http2Enabled_; }
+    void setHttp2Enabled(bool enabled) { http2Enabled_ = enabled; }
+
+    // Every finished exchange is recorded into the cassette. The cassette must outlive the client.
+    HttpCassette* recorder() const { return recorder_; }
+    void setRecorder(HttpCassette* cassette) { recorder_ = cassette; }
+
+    const QHash<QString, ConnectionStats>& connectionStats() const { return connectionStats_; }
+
     HttpResponse* startRequest(const HttpRequest& request);
 
-private slots:
-    void onAuthenticationRequired(QNetworkReply* reply, QAuthenticator* authenticator);
-    void onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors);
+private:
+    QNetworkRequest makeNetworkRequest(const HttpRequest& request) const;
+    HttpResponse* trackResponse(const QString& origin, QNetworkReply* reply);
+    void recordExchange(const HttpRequest& request, HttpResponse* response);
 
 private:
-    HttpUserDelegate* delegate_;
-    QNetworkAccessManager qnam_;
+    HttpTransport* transport_;
+    bool http2Enabled_{};
+    HttpCassette* recorder_{};
+    QHash<QString, ConnectionStats> connectionStats_;
 };
@@ -0,0 +1,119 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "HttpNetworkTransport.h"
+
+#include "HttpBody.h"
+#include "HttpUserDelegate.h"
+#include "Tools.h"
+#include <QAuthenticator>
+#include <QNetworkReply>
+
+namespace {
+
+void checkTLSSupport(const QNetworkRequest& request)
+{
+    if (request.url().scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) && !QSslSocket::supportsSsl())
+    {
+        qCCritical(MLC_LOG_CAT) << "No TLS Support. Required TLS library version version:" <<
+            QSslSocket::sslLibraryBuildVersionString() <<
+            "TLS library version available:" << QSslSocket::sslLibraryVersionString();
+    }
+}
+
+QIODevice* prepareStreamedBody(QNetworkRequest& request, const HttpBody& body)
+{
+    // Without a content length and with buffering allowed QNetworkAccessManager would collect the complete
+    // body in memory before sending the first byte.
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body.size());
+    request.setAttribute(QNetworkRequest::DoNotBufferUploadDataAttribute, true);
+    return body.createDevice();
+}
+
+QNetworkReply* adoptBodyDevice(QNetworkReply* reply, QIODevice* device)
+{
+    device->setParent(reply);
+    return reply;
+}
+
+} // namespace
+
+HttpNetworkTransport::HttpNetworkTransport(HttpUserDelegate* delegate, QObject* parent) :
+    HttpTransport{parent},
+    delegate_{delegate}
+{
+    connect(&qnam_, &QNetworkAccessManager::authenticationRequired,
+            this, &HttpNetworkTransport::onAuthenticationRequired);
+    connect(&qnam_, &QNetworkAccessManager::sslErrors, this, &HttpNetworkTransport::onSslErrors);
+}
+
+QNetworkReply* HttpNetworkTransport::send(HttpRequest::Method method, const QNetworkRequest& request,
+                                          const HttpBody& body)
+{
+    checkTLSSupport(request);
+
+    switch (method)
+    {
+        using enum HttpRequest::Method;
+
+        case GET:
+        {
+            return qnam_.get(request);
+            break;
+        }
+
+        case POST:
+        {
+            if (body.isStreamed())
+            {
+                auto req = request;
+                auto device = prepareStreamedBody(req, body);
+                return adoptBodyDevice(qnam_.post(req, device), device);
+            }
+            return qnam_.post(request, body.binaryData());
+            break;
+        }
+
+        case PUT:
+        {
+            if (body.isStreamed())
+            {
+                auto req = request;
+                auto device = prepareStreamedBody(req, body);
+                return adoptBodyDevice(qnam_.put(req, device), device);
+            }
+            return qnam_.put(request, body.binaryData());
+            break;
+        }
+
+        case DELETE:
+        {
+            return qnam_.deleteResource(request);
+            break;
+        }
+    }
+
+    Q_UNREACHABLE();
+}
+
+void HttpNetworkTransport::onAuthenticationRequired(QNetworkReply* reply, QAuthenticator* authenticator)
+{
+    Q_UNUSED(authenticator)
+
+    reply->abort();
+}
+
+void HttpNetworkTransport::onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors)
+{
+    QString errorString;
+    for (const QSslError &error : errors) {
+        if (!errorString.isEmpty())
+            errorString += QLatin1Char('\n');
+        errorString += error.errorString();
+    }
+
+    if (delegate_->askRecoverableError(tr("SSL Errors"), tr("One or more SSL errors has occurred:\n%1").arg(errorString)))
+    {
+        reply->ignoreSslErrors();
+    }
+}
@@ -0,0 +1,27 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpTransport.h"
+#include <QNetworkAccessManager>
+
+class HttpUserDelegate;
+
+class HttpNetworkTransport : public HttpTransport
+{
+    Q_OBJECT
+
+public:
+    HttpNetworkTransport(HttpUserDelegate* delegate, QObject* parent = {});
+
+    QNetworkReply* send(HttpRequest::Method method, const QNetworkRequest& request, const HttpBody& body) override;
+
+private slots:
+    void onAuthenticationRequired(QNetworkReply* reply, QAuthenticator* authenticator);
+    void onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors);
+
+private:
+    HttpUserDelegate* delegate_;
+    QNetworkAccessManager qnam_;
+};
@@ -0,0 +1,44 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "HttpReplayTransport.h"
+
+#include "HttpBody.h"
+#include "HttpCannedReply.h"
+#include "HttpCassette.h"
+#include <limits>
+
+HttpReplayTransport::HttpReplayTransport(HttpCassette* cassette, double timeScale, QObject* parent) :
+    HttpTransport{parent},
+    cassette_{cassette},
+    timeScale_{qMax(0.0, timeScale)}
+{
+}
+
+QNetworkReply* HttpReplayTransport::send(HttpRequest::Method method, const QNetworkRequest& request,
+                                         const HttpBody& body)
+{
+    const auto operation = HttpCannedReply::operationFor(method);
+
+    // Streamed bodies are not part of the recording, see HttpClient::recordExchange
+    const auto requestBody = body.isStreamed() ? QByteArray{} : body.binaryData();
+
+    const auto exchange = cassette_->take(method, request.url(), requestBody);
+    if (!exchange)
+    {
+        auto reply = new HttpCannedReply{request, operation, 0, {}, {}, this};
+        reply->setNetworkError(QNetworkReply::ContentNotFoundError,
+                               tr("No recorded exchange for %1").arg(request.url().toString()));
+        reply->finishAfter(0);
+        return reply;
+    }
+
+    auto reply = new HttpCannedReply{request, operation, exchange->statusCode, exchange->contentType,
+                                     exchange->responseBody, this};
+    if (exchange->statusCode <= 0 && exchange->networkError != QNetworkReply::NoError)
+        reply->setNetworkError(exchange->networkError, exchange->errorString);
+
+    const auto delay = static_cast<double>(exchange->durationMs) * timeScale_;
+    reply->finishAfter(static_cast<int>(qMin(delay, static_cast<double>(std::numeric_limits<int>::max()))));
+    return reply;
+}
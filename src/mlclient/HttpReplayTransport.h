@@ -0,0 +1,24 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpTransport.h"
+
+class HttpCassette;
+
+// Answers requests from the exchanges of a recorded cassette instead of a server. Each reply is delayed by the
+// recorded duration multiplied by the time scale, 0 replays as fast as possible.
+class HttpReplayTransport : public HttpTransport
+{
+    Q_OBJECT
+
+public:
+    HttpReplayTransport(HttpCassette* cassette, double timeScale = 1.0, QObject* parent = {});
+
+    QNetworkReply* send(HttpRequest::Method method, const QNetworkRequest& request, const HttpBody& body) override;
+
+private:
+    HttpCassette* cassette_;
+    double timeScale_;
+};
@@ -0,0 +1,23 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpRequest.h"
+#include <QObject>
+
+class HttpBody;
+class QNetworkReply;
+class QNetworkRequest;
+
+// Carries a prepared request to a server and returns the pending reply. The default implementation uses
+// QNetworkAccessManager, other implementations serve replies without any socket involved.
+class HttpTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+    virtual QNetworkReply* send(HttpRequest::Method method, const QNetworkRequest& request, const HttpBody& body) = 0;
+};
@@ -0,0 +1,79 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlBatchTuner.h"
+
+#include <QtMath>
+
+namespace {
+
+constexpr double GrowFactor = 1.5;
+constexpr double FailureFactor = 0.5;
+// Throughput changes smaller than this count as noise
+constexpr double Tolerance = 0.05;
+
+} // namespace
+
+void MlBatchTuner::setSize(int size)
+{
+    size_ = qBound(MinSize, size, MaxSize);
+    direction_ = 1;
+    lastThroughput_ = 0;
+    resetSamples();
+}
+
+void MlBatchTuner::addSample(qsizetype pids, qint64 latencyMs)
+{
+    if (pids <= 0)
+        return;
+
+    if (latencyMs > MaxLatencyMs)
+    {
+        direction_ = -1;
+        lastThroughput_ = 0;
+        step(1.0 / GrowFactor);
+        return;
+    }
+
+    samplePids_ += pids;
+    sampleMs_ += qMax<qint64>(1, latencyMs);
+    if (++samples_ < SamplesPerStep)
+        return;
+
+    const auto throughput = double(samplePids_) * 1000.0 / double(sampleMs_);
+
+    if (lastThroughput_ > 0 && throughput < lastThroughput_ * (1.0 - Tolerance))
+    {
+        direction_ = -direction_;
+    }
+    else if (lastThroughput_ > 0 && throughput < lastThroughput_ * (1.0 + Tolerance))
+    {
+        // Plateau, stay and measure again
+        lastThroughput_ = throughput;
+        resetSamples();
+        return;
+    }
+
+    lastThroughput_ = throughput;
+    step(direction_ > 0 ? GrowFactor : 1.0 / GrowFactor);
+}
+
+void MlBatchTuner::addFailure()
+{
+    direction_ = -1;
+    lastThroughput_ = 0;
+    step(FailureFactor);
+}
+
+void MlBatchTuner::step(double factor)
+{
+    size_ = qBound(MinSize, qRound(size_ * factor), MaxSize);
+    resetSamples();
+}
+
+void MlBatchTuner::resetSamples()
+{
+    samples_ = 0;
+    samplePids_ = 0;
+    sampleMs_ = 0;
+}
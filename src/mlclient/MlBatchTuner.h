@@ -0,0 +1,42 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QtGlobal>
+
+// Tunes the PID count per read chunk of an endpoint while loads run, by hill climbing on the observed throughput.
+//
+// After a few chunks at one size the PIDs per second are compared with the previous size. The size keeps moving in
+// the same direction while throughput improves and turns around when it gets worse. Failed reads and chunks slower
+// than the latency limit shrink the size right away.
+class MlBatchTuner
+{
+public:
+    static constexpr int MinSize = 50;
+    static constexpr int MaxSize = 10000;
+    static constexpr int InitialSize = 100;
+    static constexpr int SamplesPerStep = 3;
+    static constexpr qint64 MaxLatencyMs = 30 * 1000;
+
+public:
+    int size() const { return size_; }
+    // Starting point, e.g. the size tuned in an earlier session
+    void setSize(int size);
+
+    void addSample(qsizetype pids, qint64 latencyMs);
+    void addFailure();
+
+private:
+    void step(double factor);
+    void resetSamples();
+
+private:
+    int size_{InitialSize};
+    int direction_{1};
+    int samples_{};
+    qint64 samplePids_{};
+    qint64 sampleMs_{};
+    // PIDs per second measured at the previous size, 0 if there is nothing to compare with
+    double lastThroughput_{};
+};
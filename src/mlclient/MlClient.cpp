@@ -3,15 +3,24 @@
 
 #include "MlClient.h"
 
+#include "MlBatchTuner.h"
+#include "MlDiskCache.h"
+#include "MlRecordCache.h"
 #include "MlTokens.h"
 #include "HttpClient.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "Tools.h"
+#include <QElapsedTimer>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
 #include <QUrlQuery>
+#include <algorithm>
+#include <functional>
 #include <utility>
 
 class MlConversation : public QObject
@@ -28,9 +37,13 @@ public:
 
     void start()
     {
+        timer_.start();
         createSession();
     }
 
+    // Time since the conversation left the scheduler queue
+    qint64 elapsedMs() const { return timer_.isValid() ? timer_.elapsed() : 0; }
+
 signals:
     void logMessage(QtMsgType type, const QString& message);
     void finished(const MlClient::Error& error, const QVariant& data);
@@ -102,7 +115,7 @@ private:
         logInfo("Create token"_l1);
 
         QString path = "/sessions/"_l1 + sessionId_ + "/tokens"_l1;
-        auto body = HttpBody::fromJson(createTokenObject());
+        auto body = createTokenBody();
 
         auto response = startRequest(HttpRequest::Method::POST, path, {}, body);
 
@@ -115,8 +128,10 @@ private:
 
                 logError("Failed to create token"_l1, error, statusCode, messageFromServer);
 
-                const MlClient::Error err{messageFromServer};
+                const MlClient::Error err{messageFromServer, statusCode};
                 emit finished(err, {});
+
+                deleteSession();
             }
             else
             {
@@ -183,13 +198,14 @@ protected:
     const QString& sessionId() const { return sessionId_; }
     const QString& tokenId() const { return tokenId_; }
 
-    virtual QJsonObject createTokenObject() = 0;
+    virtual HttpBody createTokenBody() = 0;
     virtual void doActualRequest() = 0;
 
 private:
     static QAtomicInteger<quint64> idSource_;
     quint64 id_;
     MlClient* mlClient_;
+    QElapsedTimer timer_;
     QString sessionId_{};
     QString tokenId_{};
 };
@@ -212,9 +228,14 @@ public:
     {
     }
 
-    QJsonObject createTokenObject() override
+    qint64 responseBytes() const { return responseBytes_; }
+
+    // Whether the error came from the read itself, not from setting up the session or token
+    bool readFailed() const { return readFailed_; }
+
+    HttpBody createTokenBody() override
     {
-        return makeReadPatientToken(apiVersion_, pids_, fields_);
+        return makeReadPatientTokenBody(apiVersion_, pids_, fields_);
     }
 
     void doActualRequest() override
@@ -235,10 +256,15 @@ public:
 
                 logError("Failed to get patient data"_l1, error, statusCode, messageFromServer);
 
-                emit finished(messageFromServer, {});
+                readFailed_ = true;
+                emit finished(MlClient::Error{messageFromServer, statusCode}, {});
+
+                deleteSession();
             }
             else
             {
+                responseBytes_ = response->body().size();
+
                 auto responseObject = response->body().toJsonArray();
 
                 auto patientData = parseResponse(responseObject);
@@ -262,12 +288,22 @@ private:
         for (const auto& val : json)
         {
             const auto fields = val.toObject()["fields"_l1].toObject();
-            const auto pid = findPid(val.toObject()["ids"_l1].toArray());
+            const auto ids = val.toObject()["ids"_l1].toArray();
+            const auto pid = findPid(ids);
 
             MlClient::PatientRecord rec;
 
             rec.insert(MlClient::ID_TYPE, pid);
 
+            // Further ID types requested as ID fields
+            for (const auto& id : ids)
+            {
+                const auto idObj = id.toObject();
+                const auto idType = idObj["idType"_l1].toString();
+                if (idType != MlClient::ID_TYPE)
+                    rec.insert(idTypeField(idType), idObj["idString"_l1].toString());
+            }
+
             for (auto it = fields.begin(); it != fields.end(); ++it)
             {
                 rec.insert(it.key(), it.value().toString());
@@ -294,6 +330,200 @@ private:
     QVersionNumber apiVersion_;
     QStringList pids_;
     QStringList fields_;
+    qint64 responseBytes_{};
+    bool readFailed_{};
+};
+
+// *********************************************************************************************************************
+
+// Loads a PID list in chunks. Every chunk is a conversation of its own which is scheduled separately, so a long bulk
+// load gives way to interactive requests between its chunks.
+//
+// Chunks are cut while the load runs, with only a few of them queued at a time. A chunk ends at the PID count limit,
+// when its token would exceed the token size limit or when its response is predicted to exceed the response size
+// limit. The prediction uses the record size learned from the responses of the endpoint so far.
+//
+// A chunk whose read the server rejects as a bad request (usually because of a single malformed or unknown PID) is
+// split in halves which are retried, until the offending PIDs are isolated. They are reported as rejected while all
+// other PIDs load normally, at the cost of about two reads per bad PID and halving step. Only when single PIDs are
+// rejected with the same message while no read has succeeded yet, the error does not depend on the PIDs and the job
+// fails instead.
+class LoadPatientDataJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadPatientDataJob(QVersionNumber apiVersion, QStringList pids, QStringList fields,
+                       MlClient* mlClient, QObject* parent = {}) :
+        QObject{parent},
+        apiVersion_{std::move(apiVersion)},
+        pids_{std::move(pids)},
+        fields_{std::move(fields)},
+        mlClient_{mlClient},
+        priority_{mlClient->priority()}
+    {
+    }
+
+    void setPriority(MlScheduler::Priority priority) { priority_ = priority; }
+
+    void start()
+    {
+        // An empty PID list still does one round trip, like a single load always did
+        startNextChunk();
+        startQueuedChunks();
+    }
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    void finished(const MlClient::Error& error, const QVariant& data);
+
+private:
+    // Enough to keep all slots the scheduler gives to bulk loads busy
+    static constexpr int ChunksInFlight = MlScheduler::MaxConcurrent;
+
+    // Halves waiting for a free slot go first, they finish a split the caller is already waiting for
+    void startQueuedChunks()
+    {
+        while (pendingChunks_ < ChunksInFlight)
+        {
+            if (!retryChunks_.isEmpty())
+            {
+                startChunk(retryChunks_.takeFirst());
+            }
+            else if (pos_ < pids_.size())
+            {
+                startNextChunk();
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    void startNextChunk()
+    {
+        const auto maxTokenBytes = mlClient_->maxReadTokenBytes();
+        const auto maxResponseBytes = mlClient_->maxReadResponseBytes();
+        const auto recordBytes = mlClient_->predictedRecordBytes(fields_.size());
+        const auto chunkSize = qMax(1, mlClient_->chunkSizeFor(fields_));
+
+        auto tokenBytes = readPatientTokenBaseSize(fields_);
+        qint64 responseBytes = 0;
+        qsizetype count = 0;
+        while (pos_ + count < pids_.size() && count < chunkSize)
+        {
+            tokenBytes += readPatientTokenIdSize(pids_[pos_ + count]);
+            responseBytes += recordBytes;
+            if (count > 0 && (tokenBytes > maxTokenBytes || responseBytes > maxResponseBytes))
+                break;
+            ++count;
+        }
+
+        // The remainder at the end of the list says nothing about the best chunk size
+        const bool representative = count == chunkSize || pos_ + count < pids_.size();
+
+        startChunk(pids_.mid(pos_, count), representative);
+        pos_ += count;
+    }
+
+    void startChunk(const QStringList& pids, bool representative = false)
+    {
+        auto conversation = new LoadPatientDataConversation(apiVersion_, pids, fields_, mlClient_, this);
+        ++pendingChunks_;
+
+        connect(conversation, &LoadPatientDataConversation::logMessage, this, &LoadPatientDataJob::logMessage);
+        connect(conversation, &LoadPatientDataConversation::finished, this,
+                [this, conversation, pids, representative](const MlClient::Error& error, const QVariant& data) {
+            conversation->deleteLater();
+            --pendingChunks_;
+
+            if (representative)
+                mlClient_->tuneChunkSize(fields_, pids.size(), conversation->elapsedMs(), error);
+
+            if (failed_)
+                return;
+
+            // A bad request while creating the token (e.g. an undefined field) fails for every part of the list
+            const bool rejected = error && error.statusCode == 400 && conversation->readFailed();
+
+            if (rejected)
+            {
+                if (!bisect(pids, error))
+                {
+                    failed_ = true;
+                    emit finished(error, {});
+                    return;
+                }
+            }
+            else if (error)
+            {
+                // Chunks still queued or running are dropped together with the job
+                failed_ = true;
+                emit finished(error, {});
+                return;
+            }
+            else
+            {
+                const auto chunkData = data.value<MlClient::PatientData>();
+                mlClient_->learnResponseSize(chunkData.size(), fields_.size(), conversation->responseBytes());
+                patientData_ << chunkData;
+                anyLoaded_ = true;
+            }
+
+            startQueuedChunks();
+
+            if (pendingChunks_ == 0)
+            {
+                MlClient::Error result;
+                result.rejectedPids = rejectedPids_;
+                emit finished(result, QVariant::fromValue(patientData_));
+            }
+        });
+
+        mlClient_->startConversation(conversation, priority_);
+    }
+
+    // False if the rejection does not depend on the PIDs, bisecting further would only repeat it
+    bool bisect(const QStringList& pids, const MlClient::Error& error)
+    {
+        if (pids.size() <= 1)
+        {
+            const auto pid = pids.value(0);
+
+            // Another PID rejected alike while nothing loaded suggests the server rejects every read
+            const auto other = rejectionPids_.constFind(error.message);
+            if (!anyLoaded_ && other != rejectionPids_.cend() && other.value() != pid)
+                return false;
+            rejectionPids_.insert(error.message, pid);
+
+            rejectedPids_.insert(pid, error.message);
+            emit logMessage(QtWarningMsg, tr("Server rejected PID %1: %2").arg(pid, error.message));
+            return true;
+        }
+
+        emit logMessage(QtInfoMsg, tr("Server rejected read of %1 patients, retrying in halves").arg(pids.size()));
+
+        const auto half = pids.size() / 2;
+        retryChunks_ << pids.mid(0, half) << pids.mid(half);
+        return true;
+    }
+
+private:
+    QVersionNumber apiVersion_;
+    QStringList pids_;
+    QStringList fields_;
+    MlClient* mlClient_;
+    MlScheduler::Priority priority_;
+    qsizetype pos_{};
+    int pendingChunks_{};
+    bool failed_{};
+    QList<QStringList> retryChunks_{};
+    bool anyLoaded_{};
+    // A PID rejected with each message so far
+    QHash<QString, QString> rejectionPids_{};
+    MlClient::PatientData patientData_{};
+    QHash<QString, QString> rejectedPids_{};
 };
 
 // *********************************************************************************************************************
@@ -313,9 +543,9 @@ public:
             patientData_.insert("sureness"_l1, "true"_l1);
     }
 
-    QJsonObject createTokenObject() override
+    HttpBody createTokenBody() override
     {
-        return makeCreatePatientToken(apiVersion_);
+        return HttpBody::fromJson(makeCreatePatientToken(apiVersion_));
     }
 
     void doActualRequest() override
@@ -337,7 +567,9 @@ public:
 
                 logError("Failed to query patient data"_l1, error, statusCode, messageFromServer);
 
-                emit finished(messageFromServer, {});
+                emit finished(MlClient::Error{messageFromServer, statusCode}, {});
+
+                deleteSession();
             }
             else
             {
@@ -406,6 +638,166 @@ private:
 
 // *********************************************************************************************************************
 
+// Queries many patients, one conversation each. At most QueriesInFlight are handed to the scheduler at once and new
+// queries are started no faster than the client's query rate, so a bulk lookup does not flood the server.
+class QueryPatientsJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    QueryPatientsJob(QVersionNumber apiVersion, QList<QHash<QString, QString>> patients,
+                     MlClient* mlClient, QObject* parent = {}) :
+        QObject{parent},
+        apiVersion_{std::move(apiVersion)},
+        patients_{std::move(patients)},
+        mlClient_{mlClient},
+        priority_{mlClient->priority()},
+        minIntervalMs_{mlClient->maxQueryRate() > 0 ? 1000 / mlClient->maxQueryRate() : 0},
+        results_(patients_.size())
+    {
+        pacer_.setSingleShot(true);
+        connect(&pacer_, &QTimer::timeout, this, &QueryPatientsJob::startQueries);
+    }
+
+    void start()
+    {
+        if (patients_.isEmpty())
+        {
+            QMetaObject::invokeMethod(this, [this]() { emit finished({}, results_); }, Qt::QueuedConnection);
+            return;
+        }
+
+        startQueries();
+    }
+
+signals:
+    void logMessage(QtMsgType type, const QString& message);
+    void progress(int done, int total);
+    void finished(const MlClient::Error& error, const QList<MlClient::QueryResult>& results);
+
+private:
+    // Enough to keep all slots the scheduler gives to bulk requests busy
+    static constexpr int QueriesInFlight = MlScheduler::MaxConcurrent;
+
+    void startQueries()
+    {
+        while (!error_ && pendingQueries_ < QueriesInFlight && pos_ < patients_.size())
+        {
+            if (sinceLastStart_.isValid() && sinceLastStart_.elapsed() < minIntervalMs_)
+            {
+                pacer_.start(static_cast<int>(minIntervalMs_ - sinceLastStart_.elapsed()));
+                return;
+            }
+
+            sinceLastStart_.start();
+            startQuery(pos_++);
+        }
+    }
+
+    void startQuery(qsizetype index)
+    {
+        auto conversation = new QueryPatientDataConversation(apiVersion_, patients_[index], false, mlClient_, this);
+        ++pendingQueries_;
+
+        // Every query logs its round trip, only failures are worth passing on for thousands of them
+        connect(conversation, &QueryPatientDataConversation::logMessage,
+                this, [this](QtMsgType type, const QString& message) {
+            if (type != QtInfoMsg)
+                emit logMessage(type, message);
+        });
+        connect(conversation, &QueryPatientDataConversation::finished,
+                this, [this, conversation, index](const MlClient::Error& error, const QVariant& data) {
+            conversation->deleteLater();
+            --pendingQueries_;
+            ++done_;
+
+            if (error)
+            {
+                results_[index].error = error.message;
+                ++failed_;
+                ++errorCounts_[error.message];
+
+                // Only a bad request is about this patient, any other error (e.g. a wrong API key or no
+                // connection) would fail all following queries as well
+                if (error.statusCode != 400 && !error_)
+                    error_ = error;
+            }
+            else
+            {
+                results_[index] = data.value<MlClient::QueryResult>();
+            }
+
+            emit progress(static_cast<int>(done_), static_cast<int>(patients_.size()));
+
+            if (error_ && pendingQueries_ == 0)
+            {
+                for (auto i = pos_; i < patients_.size(); ++i)
+                {
+                    results_[i].error = tr("Not sent");
+                }
+                emit finished(MlClient::Error{tr("Bulk query stopped after %1 of %2 patients: %3")
+                                              .arg(QString::number(done_), QString::number(patients_.size()),
+                                                   error_.message), error_.statusCode}, results_);
+                return;
+            }
+
+            if (done_ == patients_.size())
+            {
+                MlClient::Error result;
+                if (failed_ == done_)
+                    result = MlClient::Error{tr("All %1 queries failed: %2").arg(failed_).arg(errorSummary())};
+                emit finished(result, results_);
+                return;
+            }
+
+            if (!pacer_.isActive())
+                startQueries();
+        });
+
+        mlClient_->startConversation(conversation, priority_);
+    }
+
+    // The most frequent error messages with their counts
+    QString errorSummary() const
+    {
+        QList<QPair<qsizetype, QString>> counts;
+        for (auto it = errorCounts_.cbegin(); it != errorCounts_.cend(); ++it)
+        {
+            counts << qMakePair(it.value(), it.key());
+        }
+        std::sort(counts.begin(), counts.end(), std::greater<>{});
+
+        QStringList messages;
+        for (qsizetype i = 0; i < counts.size() && i < MaxSummarizedErrors; ++i)
+        {
+            messages << tr("%1 (%2 times)").arg(counts[i].second, QString::number(counts[i].first));
+        }
+        if (counts.size() > MaxSummarizedErrors)
+            messages << tr("%1 other errors").arg(counts.size() - MaxSummarizedErrors);
+        return messages.join(QStringLiteral("; "));
+    }
+
+private:
+    static constexpr qsizetype MaxSummarizedErrors = 3;
+
+    QVersionNumber apiVersion_;
+    QList<QHash<QString, QString>> patients_;
+    MlClient* mlClient_;
+    MlScheduler::Priority priority_;
+    qint64 minIntervalMs_;
+    QList<MlClient::QueryResult> results_;
+    QTimer pacer_;
+    QElapsedTimer sinceLastStart_;
+    qsizetype pos_{};
+    int pendingQueries_{};
+    qsizetype done_{};
+    qsizetype failed_{};
+    QHash<QString, qsizetype> errorCounts_{};
+    MlClient::Error error_{};
+};
+
+// *********************************************************************************************************************
+
 class EditPatientDataConversation : public MlConversation
 {
     Q_OBJECT
@@ -420,9 +812,9 @@ public:
     {
     }
 
-    QJsonObject createTokenObject() override
+    HttpBody createTokenBody() override
     {
-        return makeEditPatientToken(apiVersion_, pid_);
+        return HttpBody::fromJson(makeEditPatientToken(apiVersion_, pid_));
     }
 
     void doActualRequest() override
@@ -443,7 +835,9 @@ public:
 
                 logError("Failed to edit patient data"_l1, error, statusCode, messageFromServer);
 
-                emit finished(messageFromServer, {});
+                emit finished(MlClient::Error{messageFromServer, statusCode}, {});
+
+                deleteSession();
             }
             else
             {
@@ -466,32 +860,746 @@ private:
 
 // *********************************************************************************************************************
 
+// A small load waiting in a batch for the collection window to end
+struct MlPendingRead
+{
+    QPointer<MlClient> client{};
+    QStringList pids{};
+    QStringList fields{};
+    std::function<void(const MlClient::Error&, const MlClient::PatientData&)> callback{};
+};
+
+namespace {
+
+// Response bytes of a record without fields (IDs and JSON structure) and the guess for a field until reads are seen
+constexpr qint64 RecordBaseBytes = 64;
+constexpr double InitialBytesPerField = 32.0;
+// Weight of the latest read in the learned record size
+constexpr double ResponseSizeLearningRate = 0.2;
+
+} // namespace
+
+// State shared by all clients of the process which talk to the same endpoint with the same API key. Clients are created
+// per user action, so anything which has to see concurrent actions lives here. Other API keys may have other
+// permissions, so their cached records are kept apart. Only accessed from the main thread.
+struct MlEndpointState
+{
+    // Loads in flight by request key, identical loads attach to these instead of issuing another read
+    QHash<QString, QPointer<LoadPatientDataJob>> inFlightLoads;
+    MlClient::ReadStats readStats;
+    MlScheduler scheduler;
+    MlRecordCache cache;
+    // Small loads collected in the current window, by API key, version and priority
+    QHash<QString, QList<MlPendingRead>> pendingReads;
+    // Counts the batches of each key, a window timer only flushes the batch it was started for
+    QHash<QString, quint64> batchGenerations;
+    // Average response bytes per field of a record, learned from the reads so far
+    double bytesPerField{InitialBytesPerField};
+    MlBatchTuner batchTuner;
+
+    // States live until the process ends, so cached data survives the clients
+    static QHash<QString, QSharedPointer<MlEndpointState>>& all()
+    {
+        static QHash<QString, QSharedPointer<MlEndpointState>> states;
+        return states;
+    }
+
+    static QSharedPointer<MlEndpointState> forEndpoint(const QString& baseUrl, const QString& apiKey)
+    {
+        auto& states = all();
+
+        const auto key = baseUrl + QLatin1Char('\n') + apiKey;
+        auto state = states.value(key);
+        if (!state)
+        {
+            state.reset(new MlEndpointState{});
+            states.insert(key, state);
+        }
+        return state;
+    }
+};
+
+namespace {
+
+QString loadKey(const QString& apiKey, const QStringList& pids, const QStringList& fields)
+{
+    auto sortedPids = pids;
+    sortedPids.sort();
+    sortedPids.removeDuplicates();
+
+    auto sortedFields = fields;
+    sortedFields.sort();
+    sortedFields.removeDuplicates();
+
+    return apiKey + QLatin1Char('\n') + sortedPids.join(QLatin1Char(',')) +
+            QLatin1Char('\n') + sortedFields.join(QLatin1Char(','));
+}
+
+} // namespace
+
+// *********************************************************************************************************************
+
 #include "MlClient.moc"
 
 // *********************************************************************************************************************
 
 const QString MlClient::ID_TYPE = QStringLiteral("pid");
 
+QString MlClient::idField(const QString& idType)
+{
+    return idTypeField(idType);
+}
+
+QString MlClient::idTypeOf(const QString& field)
+{
+    return idTypeOfField(field);
+}
+
 MlClient::MlClient(QString baseUrl, QVersionNumber apiVersion, QString apiKey, QObject* parent) :
     QObject{parent},
     baseUrl_{std::move(baseUrl)},
     apiVersion_{std::move(apiVersion)},
     apiKey_{std::move(apiKey)},
-    http_{new HttpClient{this, this}}
+    http_{new HttpClient{this, this}},
+    endpoint_{MlEndpointState::forEndpoint(baseUrl_, apiKey_)}
 {
 }
 
+void MlClient::setTransport(HttpTransport* transport)
+{
+    http_->setTransport(transport);
+}
+
+void MlClient::setHttp2Enabled(bool enabled)
+{
+    http_->setHttp2Enabled(enabled);
+}
+
+void MlClient::setRecorder(HttpCassette* cassette)
+{
+    http_->setRecorder(cassette);
+}
+
+QHash<QString, HttpClient::ConnectionStats> MlClient::connectionStats() const
+{
+    return http_->connectionStats();
+}
+
+MlClient::ReadStats MlClient::readStats() const
+{
+    return endpoint_->readStats;
+}
+
+MlClient::QueueStats MlClient::queueStats(Priority priority) const
+{
+    return endpoint_->scheduler.stats(priority);
+}
+
+void MlClient::setCacheTtl(qint64 ms)
+{
+    endpoint_->cache.setTtl(ms);
+}
+
+void MlClient::setCacheBudget(qsizetype bytes)
+{
+    endpoint_->cache.setBudget(bytes);
+}
+
+void MlClient::setNegativeCacheTtl(qint64 ms)
+{
+    endpoint_->cache.setNegativeTtl(ms);
+}
+
+void MlClient::clearCache()
+{
+    endpoint_->cache.clear();
+}
+
+void MlClient::setDiskCache(const QSharedPointer<MlDiskCache>& diskCache)
+{
+    auto& cache = endpoint_->cache;
+    cache.setStaleTtl(diskCache ? diskCache->ttl() : 0);
+    if (cache.store() == diskCache)
+        return;
+
+    cache.clear();
+    cache.setStore(diskCache);
+}
+
+void MlClient::purgeCaches()
+{
+    const auto& states = MlEndpointState::all();
+    for (const auto& state : states)
+    {
+        state->cache.clear();
+        if (state->cache.store())
+            state->cache.store()->purge();
+    }
+}
+
+void MlClient::deleteWhenIdle()
+{
+    deleteWhenIdle_ = true;
+    if (backgroundJobs_ == 0)
+        deleteLater();
+}
+
 void MlClient::loadPatientData(const QStringList& pids, const QStringList& fields)
 {
-    auto conversation = new LoadPatientDataConversation(apiVersion_, pids, fields, this, this);
-    connect(conversation, &LoadPatientDataConversation::logMessage, this, &MlClient::logMessage);
-    connect(conversation, &LoadPatientDataConversation::finished,
-            this, [this](const Error& error, const QVariant& data) {
+    loadRecords(pids, fields, [this](const Error& error, const PatientData& data) {
+        emit patientDataLoadingDone(error, data);
+    });
+}
+
+void MlClient::prefetchPatientData(const QStringList& pids, const QStringList& fields)
+{
+    for (const auto& pid : pids)
+    {
+        if (prefetchingPids_.contains(pid) || (cacheEnabled_ && endpoint_->cache.contains(pid, fields)))
+            continue;
+
+        // One load per patient, registered under the key an interactive load of just this patient has
+        prefetchingPids_.insert(pid);
+        ++backgroundJobs_;
+        loadRecords({pid}, fields, [this, pid](const Error&, const PatientData&) {
+            prefetchingPids_.remove(pid);
+            if (--backgroundJobs_ == 0 && deleteWhenIdle_)
+                deleteLater();
+        });
+    }
+}
+
+void MlClient::checkPatientsExist(const QStringList& pids)
+{
+    loadRecords(pids, {}, [this, pids](const Error& error, const PatientData& data) {
+        QStringList existingPids;
+        existingPids.reserve(data.size());
+        for (const auto& record : data)
+        {
+            existingPids << record.value(ID_TYPE);
+        }
+
+        if (!error)
+        {
+            const auto message = tr("%1 of %2 patients exist")
+                    .arg(QString::number(existingPids.size()), QString::number(pids.size()));
+            qCDebug(MLC_LOG_CAT).noquote() << message;
+            emit logMessage(QtInfoMsg, message);
+        }
+
+        emit patientExistenceCheckingDone(error, existingPids);
+    });
+}
+
+void MlClient::loadRecords(const QStringList& pids, const QStringList& fields, const LoadCallback& callback)
+{
+    const bool sharded = fieldShardSize_ > 0 && fields.size() > fieldShardSize_;
+
+    if (!cacheEnabled_ && !sharded)
+    {
+        fetchPatientData(pids, fields, callback);
+        return;
+    }
+
+    MlRecordCache::Plan plan;
+    if (cacheEnabled_)
+    {
+        plan = endpoint_->cache.plan(pids, fields);
+    }
+    else
+    {
+        plan.fetches << MlRecordCache::Fetch{pids, fields};
+        plan.plannedMs = MlRecordCache::now();
+    }
+
+    if (!plan.revalidations.isEmpty())
+        revalidate(plan.revalidations, plan.plannedMs);
+
+    if (!plan.unknown.isEmpty())
+    {
+        const auto message = tr("Skipped %1 patients known to be missing on the server").arg(plan.unknown.size());
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtInfoMsg, message);
+    }
+
+    if (fieldShardSize_ > 0)
+        plan.fetches = shardFields(plan.fetches);
+
+    if (plan.fetches.isEmpty())
+    {
+        const auto message = tr("Served %1 patients from cache").arg(plan.cached.size());
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtInfoMsg, message);
+
+        // Deliver asynchronously like a load from the server
+        QMetaObject::invokeMethod(this, [pids, callback, records = plan.cached]() {
+            callback({}, orderedRecords(pids, records));
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (!plan.cached.isEmpty())
+    {
+        const auto message = tr("Found %1 patients in cache, fetching missing or stale fields in %2 reads")
+                .arg(QString::number(plan.cached.size()), QString::number(plan.fetches.size()));
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtInfoMsg, message);
+    }
+
+    struct PendingLoad
+    {
+        QHash<QString, MlRecordCache::Record> records;
+        qsizetype pendingFetches{};
+        Error error{};
+        QHash<QString, QString> rejectedPids;
+        // Not returned by the server, dropped once all fetches (e.g. all field shards) are joined
+        QSet<QString> missingPids;
+    };
+
+    auto load = QSharedPointer<PendingLoad>::create();
+    load->records = std::move(plan.cached);
+    load->pendingFetches = plan.fetches.size();
+
+    for (const auto& fetch : std::as_const(plan.fetches))
+    {
+        const auto plannedMs = plan.plannedMs;
+        const auto cacheEnabled = cacheEnabled_;
+        fetchPatientData(fetch.pids, fetch.fields, [this, load, pids, fetch, plannedMs, cacheEnabled, callback](
+                         const Error& error, const PatientData& data) {
+            if (error)
+            {
+                if (!load->error)
+                    load->error = error;
+            }
+            else
+            {
+                load->rejectedPids.insert(error.rejectedPids);
+
+                QSet<QString> returned;
+                for (const auto& record : data)
+                {
+                    const auto pid = record.value(ID_TYPE);
+                    returned.insert(pid);
+                    if (cacheEnabled)
+                        endpoint_->cache.insert(pid, record, fetch.fields, plannedMs);
+
+                    auto& target = load->records[pid];
+                    for (const auto& field : fetch.fields)
+                    {
+                        const auto it = record.find(field);
+                        if (it != record.end())
+                            target.insert(field, it.value());
+                    }
+                }
+
+                // PIDs unknown to the server (maybe cached before), rejected ones are asked again next time
+                for (const auto& pid : fetch.pids)
+                {
+                    if (returned.contains(pid) || error.rejectedPids.contains(pid))
+                        continue;
+                    load->missingPids.insert(pid);
+                    if (cacheEnabled)
+                        endpoint_->cache.markUnknown(pid, plannedMs);
+                }
+            }
+
+            if (--load->pendingFetches > 0)
+                return;
+
+            if (load->error)
+            {
+                callback(load->error, {});
+            }
+            else
+            {
+                for (const auto& pid : std::as_const(load->missingPids))
+                {
+                    load->records.remove(pid);
+                }
+
+                Error result;
+                result.rejectedPids = load->rejectedPids;
+                callback(result, orderedRecords(pids, load->records));
+            }
+        });
+    }
+}
+
+void MlClient::revalidate(const QList<MlRecordCache::Fetch>& fetches, qint64 plannedMs)
+{
+    for (const auto& fetch : fetches)
+    {
+        ++endpoint_->readStats.issued;
+        ++backgroundJobs_;
+
+        auto job = new LoadPatientDataJob(apiVersion_, fetch.pids, fetch.fields, this, this);
+        job->setPriority(Priority::Background);
+
+        connect(job, &LoadPatientDataJob::logMessage, this, &MlClient::logMessage);
+        connect(job, &LoadPatientDataJob::finished,
+                this, [this, job, fetch, plannedMs](const Error& error, const QVariant& data) {
+            if (!error)
+            {
+                QSet<QString> returned;
+                const auto patientData = data.value<PatientData>();
+                for (const auto& record : patientData)
+                {
+                    const auto pid = record.value(ID_TYPE);
+                    returned.insert(pid);
+                    endpoint_->cache.insert(pid, record, fetch.fields, plannedMs);
+                }
+                for (const auto& pid : fetch.pids)
+                {
+                    if (error.rejectedPids.contains(pid))
+                        endpoint_->cache.invalidate(pid);
+                    else if (!returned.contains(pid))
+                        endpoint_->cache.markUnknown(pid, plannedMs);
+                }
+
+                const auto message = tr("Revalidated %1 cached patients").arg(fetch.pids.size());
+                qCDebug(MLC_LOG_CAT).noquote() << message;
+                emit logMessage(QtDebugMsg, message);
+            }
+
+            job->deleteLater();
+
+            if (--backgroundJobs_ == 0 && deleteWhenIdle_)
+                deleteLater();
+        });
+        job->start();
+    }
+}
+
+void MlClient::fetchPatientData(const QStringList& pids, const QStringList& fields, const LoadCallback& callback)
+{
+    const auto key = loadKey(apiKey_, pids, fields);
+
+    // An identical load is already running (e.g. the same PID opened twice), share its result. A batch carries the
+    // records of all loads merged into it, so only the records of this load are passed on.
+    if (auto running = endpoint_->inFlightLoads.value(key))
+    {
+        ++endpoint_->readStats.coalesced;
+
+        const auto message = tr("Attached to identical load already in flight");
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtInfoMsg, message);
+
+        const MlPendingRead read{this, pids, fields, callback};
+        auto done = QSharedPointer<bool>::create(false);
+        connect(running, &LoadPatientDataJob::finished,
+                this, [this, done, read](const Error& error, const QVariant& data) {
+            *done = true;
+            logReadStats();
+            deliverBatchedRead(read, error, data.value<PatientData>());
+        });
+        // The client owning the running load went away before it finished, load on our own
+        connect(running, &QObject::destroyed, this, [this, done, pids, fields, callback]() {
+            if (!*done)
+                fetchPatientData(pids, fields, callback);
+        });
+        return;
+    }
+
+    if (batchWindowMs_ > 0 && pids.size() <= BatchableReadSize)
+    {
+        enqueueBatchedRead(pids, fields, callback);
+        return;
+    }
+
+    issueLoad(pids, fields, key, callback);
+}
+
+void MlClient::startConversation(MlConversation* conversation, Priority priority)
+{
+    connect(conversation, &QObject::destroyed, [endpoint = endpoint_.toWeakRef(), conversation]() {
+        if (auto state = endpoint.toStrongRef())
+            state->scheduler.release(conversation);
+    });
+
+    endpoint_->scheduler.submit(priority, this, conversation, [conversation]() { conversation->start(); });
+}
+
+void MlClient::issueLoad(const QStringList& pids, const QStringList& fields, const QString& key,
+                         const LoadCallback& callback)
+{
+    ++endpoint_->readStats.issued;
+
+    auto job = new LoadPatientDataJob(apiVersion_, pids, fields, this, this);
+    endpoint_->inFlightLoads.insert(key, job);
+
+    connect(job, &LoadPatientDataJob::logMessage, this, &MlClient::logMessage);
+    connect(job, &LoadPatientDataJob::finished,
+            this, [this, key, job, callback](const Error& error, const QVariant& data) {
         Q_ASSERT(data.isNull() || data.canConvert<PatientData>());
-        emit patientDataLoadingDone(error, data.value<PatientData>());
-        sender()->deleteLater();
+        if (endpoint_->inFlightLoads.value(key) == job)
+            endpoint_->inFlightLoads.remove(key);
+        logConnectionStats();
+        logReadStats();
+        logQueueStats();
+        if (adaptiveChunkSize_)
+            emit chunkSizeTuned(endpoint_->batchTuner.size());
+        callback(error, data.value<PatientData>());
+        job->deleteLater();
+    });
+    job->start();
+}
+
+void MlClient::enqueueBatchedRead(const QStringList& pids, const QStringList& fields, const LoadCallback& callback)
+{
+    ++endpoint_->readStats.batched;
+
+    const auto batchKey = apiKey_ + QLatin1Char('\n') + apiVersion_.toString() +
+            QLatin1Char('\n') + MlScheduler::priorityName(priority_);
+    auto& batch = endpoint_->pendingReads[batchKey];
+    const bool opened = batch.isEmpty();
+    batch << MlPendingRead{this, pids, fields, callback};
+
+    const auto generation = endpoint_->batchGenerations.value(batchKey);
+    auto flush = [endpoint = endpoint_.toWeakRef(), batchKey, generation]() {
+        const auto state = endpoint.toStrongRef();
+        if (!state || state->batchGenerations.value(batchKey) != generation)
+            return;
+
+        ++state->batchGenerations[batchKey];
+        const auto reads = state->pendingReads.take(batchKey);
+        for (const auto& read : reads)
+        {
+            // The first caller still alive sends the batch for all
+            if (read.client)
+            {
+                read.client->issueBatchedLoad(reads);
+                return;
+            }
+        }
+    };
+
+    qsizetype batchSize = 0;
+    for (const auto& read : std::as_const(batch))
+    {
+        batchSize += read.pids.size();
+    }
+
+    if (batchSize >= MaxBatchSize)
+        flush();
+    else if (opened)
+        QTimer::singleShot(batchWindowMs_, flush);
+}
+
+void MlClient::issueBatchedLoad(const QList<MlPendingRead>& reads)
+{
+    QStringList pids;
+    QStringList fields;
+    for (const auto& read : reads)
+    {
+        pids << read.pids;
+        fields << read.fields;
+    }
+    pids.removeDuplicates();
+    fields.removeDuplicates();
+
+    ++endpoint_->readStats.issued;
+
+    const auto message = tr("Merged %1 loads into one read of %2 patients")
+            .arg(QString::number(reads.size()), QString::number(pids.size()));
+    qCDebug(MLC_LOG_CAT).noquote() << message;
+    emit logMessage(QtInfoMsg, message);
+
+    auto job = new LoadPatientDataJob(apiVersion_, pids, fields, this, this);
+    auto done = QSharedPointer<bool>::create(false);
+
+    // Each merged load is in flight with the batch, an identical load attaches to it like to a load of its own
+    QStringList keys;
+    for (const auto& read : reads)
+    {
+        keys << loadKey(apiKey_, read.pids, read.fields);
+        endpoint_->inFlightLoads.insert(keys.last(), job);
+    }
+
+    connect(job, &LoadPatientDataJob::logMessage, this, &MlClient::logMessage);
+    connect(job, &LoadPatientDataJob::finished,
+            this, [this, job, reads, keys, done](const Error& error, const QVariant& data) {
+        Q_ASSERT(data.isNull() || data.canConvert<PatientData>());
+        *done = true;
+        for (const auto& key : keys)
+        {
+            if (endpoint_->inFlightLoads.value(key) == job)
+                endpoint_->inFlightLoads.remove(key);
+        }
+        logConnectionStats();
+        logReadStats();
+        logQueueStats();
+
+        const auto patientData = data.value<PatientData>();
+        for (const auto& read : reads)
+        {
+            if (read.client)
+                deliverBatchedRead(read, error, patientData);
+        }
+        job->deleteLater();
     });
-    conversation->start();
+    // This client went away before the batch finished, the other callers load on their own
+    connect(job, &QObject::destroyed, [reads, done]() {
+        if (*done)
+            return;
+        for (const auto& read : reads)
+        {
+            if (!read.client)
+                continue;
+            const auto key = loadKey(read.client->apiKey_, read.pids, read.fields);
+            read.client->issueLoad(read.pids, read.fields, key, read.callback);
+        }
+    });
+    job->start();
+}
+
+void MlClient::deliverBatchedRead(const MlPendingRead& read, const Error& error, const PatientData& data)
+{
+    PatientData result;
+    Error readError{error.message, error.statusCode};
+
+    if (!error)
+    {
+        const QSet<QString> wanted{read.pids.begin(), read.pids.end()};
+        for (auto it = error.rejectedPids.begin(); it != error.rejectedPids.end(); ++it)
+        {
+            if (wanted.contains(it.key()))
+                readError.rejectedPids.insert(it.key(), it.value());
+        }
+
+        for (const auto& record : data)
+        {
+            const auto pid = record.value(ID_TYPE);
+            if (!wanted.contains(pid))
+                continue;
+
+            PatientRecord rec;
+            rec.insert(ID_TYPE, pid);
+            for (const auto& field : read.fields)
+            {
+                const auto it = record.find(field);
+                if (it != record.end())
+                    rec.insert(field, it.value());
+            }
+            result << rec;
+        }
+    }
+
+    read.callback(readError, result);
+}
+
+qint64 MlClient::predictedRecordBytes(qsizetype fieldCount) const
+{
+    return RecordBaseBytes + qRound64(endpoint_->bytesPerField * double(fieldCount));
+}
+
+void MlClient::learnResponseSize(qsizetype records, qsizetype fieldCount, qint64 bytes)
+{
+    if (records == 0 || fieldCount == 0 || bytes <= 0)
+        return;
+
+    const auto perRecord = double(bytes) / double(records);
+    const auto perField = qMax(1.0, (perRecord - double(RecordBaseBytes)) / double(fieldCount));
+
+    auto& learned = endpoint_->bytesPerField;
+    learned += (perField - learned) * ResponseSizeLearningRate;
+}
+
+QList<MlRecordCache::Fetch> MlClient::shardFields(const QList<MlRecordCache::Fetch>& fetches)
+{
+    QList<MlRecordCache::Fetch> shards;
+
+    for (const auto& fetch : fetches)
+    {
+        const auto fieldCount = fetch.fields.size();
+        if (fieldCount <= fieldShardSize_)
+        {
+            shards << fetch;
+            continue;
+        }
+
+        // Equal shards, 61 fields at 20 per shard become 4 shards of 15 or 16 instead of 20, 20, 20 and 1
+        const auto shardCount = (fieldCount + fieldShardSize_ - 1) / fieldShardSize_;
+        qsizetype begin = 0;
+        for (qsizetype i = 0; i < shardCount; ++i)
+        {
+            const auto end = fieldCount * (i + 1) / shardCount;
+            shards << MlRecordCache::Fetch{fetch.pids, fetch.fields.mid(begin, end - begin)};
+            begin = end;
+        }
+    }
+
+    if (shards.size() > fetches.size())
+    {
+        const auto message = tr("Split fields into %1 parallel reads").arg(shards.size());
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtInfoMsg, message);
+    }
+
+    return shards;
+}
+
+int MlClient::chunkSizeFor(const QStringList& fields) const
+{
+    if (fields.isEmpty())
+        return qMax(loadChunkSize_, int{ProbeChunkSize});
+    return adaptiveChunkSize_ ? endpoint_->batchTuner.size() : loadChunkSize_;
+}
+
+void MlClient::tuneChunkSize(const QStringList& fields, qsizetype pids, qint64 latencyMs, const Error& error)
+{
+    // Reads without fields are sized on their own
+    if (!adaptiveChunkSize_ || fields.isEmpty())
+        return;
+
+    auto& tuner = endpoint_->batchTuner;
+    const auto before = tuner.size();
+
+    // A rejected PID is not the chunk size's fault
+    if (!error)
+        tuner.addSample(pids, latencyMs);
+    else if (error.statusCode != 400)
+        tuner.addFailure();
+
+    if (tuner.size() != before)
+    {
+        const auto message = tr("Chunk size tuned from %1 to %2 PIDs")
+                .arg(QString::number(before), QString::number(tuner.size()));
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtDebugMsg, message);
+    }
+}
+
+int MlClient::tunedChunkSize() const
+{
+    return endpoint_->batchTuner.size();
+}
+
+void MlClient::setTunedChunkSize(int size)
+{
+    // Clients of an endpoint are seeded with the same stored value, don't throw away what was learned since
+    if (size > 0 && size != endpoint_->batchTuner.size())
+        endpoint_->batchTuner.setSize(size);
+}
+
+MlClient::PatientData MlClient::orderedRecords(const QStringList& pids,
+                                               const QHash<QString, PatientRecord>& records)
+{
+    PatientData result;
+    QSet<QString> seen;
+
+    for (const auto& pid : pids)
+    {
+        const auto it = records.find(pid);
+        if (it == records.end() || seen.contains(pid))
+            continue;
+        seen.insert(pid);
+
+        auto record = it.value();
+        record.insert(ID_TYPE, pid);
+        result << record;
+    }
+
+    return result;
 }
 
 void MlClient::queryPatientData(const QHash<QString, QString>& patientData, bool sureness)
@@ -501,23 +1609,51 @@ void MlClient::queryPatientData(const QHash<QString, QString>& patientData, bool
     connect(conversation, &QueryPatientDataConversation::finished,
             this, [this](const Error& error, const QVariant& data) {
         Q_ASSERT(data.isNull() || data.canConvert<QueryResult>());
-        emit patientDataQueringDone(error, data.value<QueryResult>());
+        const auto result = data.value<QueryResult>();
+        // The patient may just have been created, don't keep it as missing
+        if (!result.pid.isEmpty())
+            endpoint_->cache.invalidate(result.pid);
+        emit patientDataQueringDone(error, result);
         sender()->deleteLater();
     });
-    conversation->start();
+    startConversation(conversation, priority_);
+}
+
+void MlClient::queryPatients(const QList<QHash<QString, QString>>& patients)
+{
+    auto job = new QueryPatientsJob(apiVersion_, patients, this, this);
+    connect(job, &QueryPatientsJob::logMessage, this, &MlClient::logMessage);
+    connect(job, &QueryPatientsJob::progress, this, &MlClient::patientsQueringProgress);
+    connect(job, &QueryPatientsJob::finished,
+            this, [this, job](const Error& error, const QList<QueryResult>& results) {
+        for (const auto& result : results)
+        {
+            if (!result.pid.isEmpty())
+                endpoint_->cache.invalidate(result.pid);
+        }
+        logConnectionStats();
+        logQueueStats();
+        emit patientsQueringDone(error, results);
+        job->deleteLater();
+    });
+    job->start();
 }
 
 void MlClient::editPatientData(const QString& pid, const QHash<QString, QString>& patientData)
 {
+    // Reads running during the edit may still deliver the old values, so invalidate again when it is done
+    endpoint_->cache.invalidate(pid);
+
     auto conversation = new EditPatientDataConversation(apiVersion_, pid, patientData, this, this);
     connect(conversation, &LoadPatientDataConversation::logMessage, this, &MlClient::logMessage);
     connect(conversation, &EditPatientDataConversation::finished,
-            this, [this](const Error& error, const QVariant& data) {
+            this, [this, pid](const Error& error, const QVariant& data) {
         Q_UNUSED(data);
+        endpoint_->cache.invalidate(pid);
         emit patientDataEditingDone(error);
         sender()->deleteLater();
     });
-    conversation->start();
+    startConversation(conversation, priority_);
 }
 
 bool MlClient::askRecoverableError(const QString& title, const QString& message)
@@ -527,6 +1663,52 @@ bool MlClient::askRecoverableError(const QString& title, const QString& message)
     return true;
 }
 
+void MlClient::logConnectionStats()
+{
+    const auto& stats = http_->connectionStats();
+    for (auto it = stats.begin(); it != stats.end(); ++it)
+    {
+        const auto& s = it.value();
+        const auto protocol = s.protocol.isEmpty() ? QStringLiteral("unknown") : s.protocol;
+        const auto message = "Connection %1: protocol %2, %3 requests (%4 as HTTP/2 streams), peak %5 concurrent"_l1
+                .arg(it.key(), protocol, QString::number(s.requests), QString::number(s.http2Requests),
+                     QString::number(s.peakInFlight));
+
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtDebugMsg, message);
+    }
+}
+
+void MlClient::logReadStats()
+{
+    const auto& stats = endpoint_->readStats;
+    const auto message = "Reads on %1: %2 issued, %3 coalesced with a read in flight, %4 merged into batches"_l1
+            .arg(baseUrl_, QString::number(stats.issued), QString::number(stats.coalesced),
+                 QString::number(stats.batched));
+
+    qCDebug(MLC_LOG_CAT).noquote() << message;
+    emit logMessage(QtDebugMsg, message);
+}
+
+void MlClient::logQueueStats()
+{
+    for (int i = 0; i < static_cast<int>(Priority::_Count); ++i)
+    {
+        const auto priority = static_cast<Priority>(i);
+        const auto stats = endpoint_->scheduler.stats(priority);
+        if (stats.started == 0 && stats.queued == 0)
+            continue;
+
+        const auto message = "Queue %1: %2 waiting, %3 running, %4 started, wait avg %5 ms, max %6 ms"_l1
+                .arg(MlScheduler::priorityName(priority), QString::number(stats.queued),
+                     QString::number(stats.running), QString::number(stats.started),
+                     QString::number(stats.averageWaitMs()), QString::number(stats.maxWaitMs));
+
+        qCDebug(MLC_LOG_CAT).noquote() << message;
+        emit logMessage(QtDebugMsg, message);
+    }
+}
+
 HttpRequest MlClient::createRequest(HttpRequest::Method method, const QString& path,
                                     const QUrlQuery& query, const HttpBody& body)
 {
@@ -4,13 +4,24 @@
 #pragma once
 
 #include "HttpBody.h"
+#include "HttpClient.h"
 #include "HttpRequest.h"
 #include "HttpUserDelegate.h"
+#include "MlRecordCache.h"
+#include "MlScheduler.h"
 #include <QObject>
+#include <QSet>
+#include <QSharedPointer>
 #include <QVersionNumber>
+#include <functional>
 
-class HttpClient;
+class HttpCassette;
+class HttpTransport;
+class LoadPatientDataJob;
+class QueryPatientsJob;
 class MlConversation;
+struct MlEndpointState;
+struct MlPendingRead;
 
 class MlClient : public QObject, public HttpUserDelegate
 {
@@ -20,8 +31,11 @@ public:
     struct Error
     {
         QString message{};
+        int statusCode{};
+        // PIDs the server refused to read with its message, the load succeeded for all others
+        QHash<QString, QString> rejectedPids{};
         Error() = default;
-        Error(QString m) : message{std::move(m)} {}
+        Error(QString m, int s = 0) : message{std::move(m)}, statusCode{s} {}
         operator bool() const { return !message.isEmpty(); }
     };
 
@@ -30,18 +44,115 @@ public:
         QString pid{};
         bool tentative{};
         QStringList possibleMatchPids{};
+        // Bulk queries only: why the query of this patient failed, the other members are empty then
+        QString error{};
     };
 
+    // Counters of the endpoint, shared by all clients talking to the same base URL with the same API key
+    struct ReadStats
+    {
+        int issued{};
+        int coalesced{};
+        int batched{};
+    };
+
+    using Priority = MlScheduler::Priority;
+    using QueueStats = MlScheduler::QueueStats;
+
     using PatientRecord = QHash<QString, QString>;
     using PatientData = QList<PatientRecord>;
 
     static const QString ID_TYPE;
 
+    // Loading the field idField(type) reads the patient's ID of that type (e.g. an external ID) in the same pass
+    static QString idField(const QString& idType);
+    // The ID type behind an ID field, empty for regular fields
+    static QString idTypeOf(const QString& field);
+
+    static constexpr int DefaultLoadChunkSize = 1000;
+    static constexpr int DefaultBatchWindowMs = 15;
+    // Loads of at most this many PIDs are collected into a batch
+    static constexpr int BatchableReadSize = 10;
+    // A batch is sent as soon as it reaches this many PIDs, without waiting for the window to end
+    static constexpr int MaxBatchSize = 1000;
+    // Reads without fields return IDs only, so they are sent in much larger chunks
+    static constexpr int ProbeChunkSize = 10000;
+    // Stays below common proxy body limits (1 MiB by default in nginx)
+    static constexpr qint64 DefaultMaxReadTokenBytes = 512 * 1024;
+    static constexpr qint64 DefaultMaxReadResponseBytes = 4 * 1024 * 1024;
+    static constexpr int DefaultMaxQueryRate = 10;
+
 public:
     MlClient(QString baseUrl, QVersionNumber apiVersion, QString apiKey, QObject* parent = {});
 
+    void setTransport(HttpTransport* transport);
+    void setHttp2Enabled(bool enabled);
+    void setRecorder(HttpCassette* cassette);
+    QHash<QString, HttpClient::ConnectionStats> connectionStats() const;
+    ReadStats readStats() const;
+    QueueStats queueStats(Priority priority) const;
+
+    // Requests of all clients of an endpoint share one scheduler, interactive is the default
+    Priority priority() const { return priority_; }
+    void setPriority(Priority priority) { priority_ = priority; }
+
+    // Loads are split into reads of at most this many PIDs, each scheduled on its own
+    int loadChunkSize() const { return loadChunkSize_; }
+    void setLoadChunkSize(int size) { loadChunkSize_ = qMax(1, size); }
+
+    // Instead of the fixed chunk size, use the size tuned from the throughput of the endpoint's reads.
+    // chunkSizeTuned() reports the size after every load, it can be kept and given back as the next starting point.
+    bool adaptiveChunkSize() const { return adaptiveChunkSize_; }
+    void setAdaptiveChunkSize(bool enabled) { adaptiveChunkSize_ = enabled; }
+    int tunedChunkSize() const;
+    void setTunedChunkSize(int size);
+
+    // Chunks are cut smaller if their read token or their predicted response would exceed these sizes
+    qint64 maxReadTokenBytes() const { return maxReadTokenBytes_; }
+    void setMaxReadTokenBytes(qint64 bytes) { maxReadTokenBytes_ = bytes; }
+    qint64 maxReadResponseBytes() const { return maxReadResponseBytes_; }
+    void setMaxReadResponseBytes(qint64 bytes) { maxReadResponseBytes_ = bytes; }
+
+    // Wide field lists are split into shards of at most this many fields, read in parallel for the same PIDs and
+    // joined by PID. Spreads the serialization of wide records over server threads. 0 reads all fields at once.
+    int fieldShardSize() const { return fieldShardSize_; }
+    void setFieldShardSize(int fields) { fieldShardSize_ = qMax(0, fields); }
+
+    // Loads are served from a cache shared by all clients of the endpoint, only missing or stale fields are read
+    bool cacheEnabled() const { return cacheEnabled_; }
+    void setCacheEnabled(bool enabled) { cacheEnabled_ = enabled; }
+    void setCacheTtl(qint64 ms);
+    void setCacheBudget(qsizetype bytes);
+    // PIDs the server did not return are not asked for again within this time. 0 disables it.
+    void setNegativeCacheTtl(qint64 ms);
+    void clearCache();
+
+    // Persistent backing store of the endpoint's cache. Values older than the cache TTL but within the TTL of the
+    // disk cache are served and revalidated in the background.
+    void setDiskCache(const QSharedPointer<MlDiskCache>& diskCache);
+    // Clears the caches of all endpoints including their disk caches
+    static void purgeCaches();
+
+    // Like deleteLater, but background work started by the client (e.g. revalidation) finishes first
+    void deleteWhenIdle();
+
+    // Bulk queries start at most this many patient queries per second. 0 only limits them by the scheduler.
+    int maxQueryRate() const { return maxQueryRate_; }
+    void setMaxQueryRate(int perSecond) { maxQueryRate_ = qMax(0, perSecond); }
+
+    // Small loads arriving within the window are merged into one read. 0 disables batching.
+    int batchWindow() const { return batchWindowMs_; }
+    void setBatchWindow(int ms) { batchWindowMs_ = ms; }
+
     void loadPatientData(const QStringList& pids, const QStringList& fields);
+    // Reads every patient on its own in the background to fill the cache, a later load of one of them joins its
+    // read. Patients cached or still being prefetched by this client are skipped, no result is emitted.
+    void prefetchPatientData(const QStringList& pids, const QStringList& fields);
+    // Reads IDs only, the result lists the PIDs known to the server
+    void checkPatientsExist(const QStringList& pids);
     void queryPatientData(const QHash<QString, QString>& patientData, bool sureness);
+    // Queries all patients concurrently, the results are in the order of the patients
+    void queryPatients(const QList<QHash<QString, QString>>& patients);
     void editPatientData(const QString& pid, const QHash<QString, QString>& patientData);
 
     bool askRecoverableError(const QString& title, const QString& message) override;
@@ -50,12 +161,36 @@ signals:
     void logMessage(QtMsgType type, const QString& message);
 
     void patientDataLoadingDone(const MlClient::Error& error, const MlClient::PatientData& data);
+    void patientExistenceCheckingDone(const MlClient::Error& error, const QStringList& existingPids);
+    void chunkSizeTuned(int size);
     void patientDataQueringDone(const MlClient::Error& error, const MlClient::QueryResult& result);
+    void patientsQueringProgress(int done, int total);
+    void patientsQueringDone(const MlClient::Error& error, const QList<MlClient::QueryResult>& results);
     void patientDataEditingDone(const MlClient::Error& error);
 
 private:
     HttpRequest createRequest(HttpRequest::Method method, const QString& path,
                               const QUrlQuery& query, const HttpBody& body = {});
+    using LoadCallback = std::function<void(const Error& error, const PatientData& data)>;
+
+    void startConversation(MlConversation* conversation, Priority priority);
+    void loadRecords(const QStringList& pids, const QStringList& fields, const LoadCallback& callback);
+    void revalidate(const QList<MlRecordCache::Fetch>& fetches, qint64 plannedMs);
+    void fetchPatientData(const QStringList& pids, const QStringList& fields, const LoadCallback& callback);
+    void issueLoad(const QStringList& pids, const QStringList& fields, const QString& key,
+                   const LoadCallback& callback);
+    void enqueueBatchedRead(const QStringList& pids, const QStringList& fields, const LoadCallback& callback);
+    void issueBatchedLoad(const QList<MlPendingRead>& reads);
+    void deliverBatchedRead(const MlPendingRead& read, const Error& error, const PatientData& data);
+    QList<MlRecordCache::Fetch> shardFields(const QList<MlRecordCache::Fetch>& fetches);
+    int chunkSizeFor(const QStringList& fields) const;
+    void tuneChunkSize(const QStringList& fields, qsizetype pids, qint64 latencyMs, const Error& error);
+    qint64 predictedRecordBytes(qsizetype fieldCount) const;
+    void learnResponseSize(qsizetype records, qsizetype fieldCount, qint64 bytes);
+    static PatientData orderedRecords(const QStringList& pids, const QHash<QString, PatientRecord>& records);
+    void logConnectionStats();
+    void logReadStats();
+    void logQueueStats();
 
 private slots:
 
@@ -64,7 +199,22 @@ private:
     QVersionNumber apiVersion_;
     QString apiKey_;
     HttpClient* http_;
-
+    QSharedPointer<MlEndpointState> endpoint_;
+    Priority priority_{Priority::Interactive};
+    bool cacheEnabled_{true};
+    int loadChunkSize_{DefaultLoadChunkSize};
+    bool adaptiveChunkSize_{};
+    int fieldShardSize_{};
+    qint64 maxReadTokenBytes_{DefaultMaxReadTokenBytes};
+    qint64 maxReadResponseBytes_{DefaultMaxReadResponseBytes};
+    int batchWindowMs_{DefaultBatchWindowMs};
+    int maxQueryRate_{DefaultMaxQueryRate};
+    int backgroundJobs_{};
+    bool deleteWhenIdle_{};
+    QSet<QString> prefetchingPids_;
+
+    friend LoadPatientDataJob;
+    friend QueryPatientsJob;
     friend MlConversation;
 };
 
@@ -0,0 +1,428 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlDiskCache.h"
+
+#include "Tools.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QtEndian>
+
+namespace {
+
+constexpr quint32 FileMagic = 0x4d4c4443; // "MLDC"
+constexpr quint16 FileVersion = 1;
+constexpr auto StreamVersion = QDataStream::Qt_6_0;
+
+constexpr qsizetype PidTagSize = 16;
+constexpr qsizetype NonceSize = 16;
+constexpr qsizetype AuthTagSize = 32;
+constexpr qsizetype RecordOverhead = 4 + PidTagSize + NonceSize + AuthTagSize;
+constexpr qint64 HeaderSize = 4 + 2 + AuthTagSize;
+
+constexpr qsizetype MinDeadRecordsForCompaction = 1000;
+
+QByteArray hmac(const QByteArray& key, const QByteArray& message)
+{
+    return QMessageAuthenticationCode::hash(message, key, QCryptographicHash::Sha256);
+}
+
+QByteArray randomBytes(qsizetype count)
+{
+    Q_ASSERT(count % 4 == 0);
+
+    QByteArray bytes(count, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(bytes.data()), count / 4);
+    return bytes;
+}
+
+QByteArray serialize(const QString& pid, const MlDiskCache::Record& record)
+{
+    QByteArray data;
+    QDataStream out{&data, QIODevice::WriteOnly};
+    out.setVersion(StreamVersion);
+
+    out << pid << record.seenMs << static_cast<qint32>(record.fields.size());
+    for (auto it = record.fields.cbegin(); it != record.fields.cend(); ++it)
+    {
+        out << it.key() << it->present << it->value << it->fetchedMs;
+    }
+
+    return qCompress(data);
+}
+
+bool deserialize(const QByteArray& compressed, QString& pid, MlDiskCache::Record& record)
+{
+    const auto data = qUncompress(compressed);
+    if (data.isEmpty())
+        return false;
+
+    QDataStream in{data};
+    in.setVersion(StreamVersion);
+
+    qint32 count{};
+    in >> pid >> record.seenMs >> count;
+
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString field;
+        MlDiskCache::Value value;
+        in >> field >> value.present >> value.value >> value.fetchedMs;
+        record.fields.insert(field, value);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace
+
+MlDiskCache::MlDiskCache(QString fileName, const QByteArray& key) :
+    fileName_{std::move(fileName)},
+    encKey_{hmac(key, QByteArrayLiteral("ML-Reader record cache encryption"))},
+    macKey_{hmac(key, QByteArrayLiteral("ML-Reader record cache authentication"))},
+    file_{fileName_}
+{
+    Q_ASSERT(key.size() == KeySize);
+}
+
+MlDiskCache::~MlDiskCache() = default;
+
+bool MlDiskCache::open()
+{
+    QDir{}.mkpath(QFileInfo{fileName_}.absolutePath());
+
+    if (!file_.open(QIODevice::ReadWrite))
+    {
+        errorString_ = file_.errorString();
+        return false;
+    }
+
+    if (file_.size() == 0 || !readIndex())
+    {
+        index_.clear();
+        deadRecords_ = 0;
+
+        if (!file_.resize(0) || !file_.seek(0) || !writeHeader(file_))
+        {
+            errorString_ = file_.errorString();
+            file_.close();
+            return false;
+        }
+    }
+
+    compactIfNeeded();
+    return true;
+}
+
+bool MlDiskCache::read(const QString& pid, Record& record)
+{
+    const auto tag = pidTag(pid);
+    const auto it = index_.constFind(tag);
+    if (it == index_.cend())
+        return false;
+
+    QByteArray recordTag;
+    QByteArray plainText;
+    QString storedPid;
+    Record stored;
+    if (!readRecordAt(it.value(), recordTag, plainText) || plainText.isEmpty() ||
+            !deserialize(plainText, storedPid, stored) || storedPid != pid)
+    {
+        index_.remove(tag);
+        ++deadRecords_;
+        return false;
+    }
+
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    if (isExpired(stored, now))
+    {
+        remove(pid);
+        return false;
+    }
+
+    for (auto field = stored.fields.begin(); field != stored.fields.end();)
+    {
+        if (now - field->fetchedMs > ttlMs_)
+            field = stored.fields.erase(field);
+        else
+            ++field;
+    }
+
+    record = std::move(stored);
+    return true;
+}
+
+void MlDiskCache::write(const QString& pid, const Record& record)
+{
+    if (!file_.isOpen())
+        return;
+
+    appendRecord(pidTag(pid), serialize(pid, record));
+    compactIfNeeded();
+}
+
+void MlDiskCache::remove(const QString& pid)
+{
+    if (!file_.isOpen())
+        return;
+
+    const auto tag = pidTag(pid);
+    if (!index_.contains(tag))
+        return;
+
+    // An empty payload marks the PID as removed when the index is read again
+    appendRecord(tag, {});
+    compactIfNeeded();
+}
+
+void MlDiskCache::purge()
+{
+    index_.clear();
+    deadRecords_ = 0;
+
+    if (file_.isOpen())
+    {
+        file_.resize(0);
+        file_.seek(0);
+        writeHeader(file_);
+        file_.flush();
+    }
+}
+
+QByteArray MlDiskCache::generateKey()
+{
+    return randomBytes(KeySize);
+}
+
+QByteArray MlDiskCache::pidTag(const QString& pid) const
+{
+    return hmac(macKey_, QByteArrayLiteral("pid:") + pid.toUtf8()).left(PidTagSize);
+}
+
+QByteArray MlDiskCache::crypt(const QByteArray& nonce, const QByteArray& data) const
+{
+    QByteArray result{data};
+
+    QMessageAuthenticationCode mac{QCryptographicHash::Sha256, encKey_};
+    QByteArray counterBlock = nonce + QByteArray(8, '\0');
+
+    quint64 counter = 0;
+    for (qsizetype pos = 0; pos < result.size(); ++counter)
+    {
+        qToBigEndian(counter, counterBlock.data() + NonceSize);
+
+        mac.reset();
+        mac.addData(counterBlock);
+        const auto keyStream = mac.result();
+
+        for (qsizetype i = 0; i < keyStream.size() && pos < result.size(); ++i, ++pos)
+        {
+            result[pos] = static_cast<char>(result[pos] ^ keyStream[i]);
+        }
+    }
+
+    return result;
+}
+
+QByteArray MlDiskCache::authTag(const QByteArray& pidTag, const QByteArray& nonce, const QByteArray& cipherText) const
+{
+    QMessageAuthenticationCode mac{QCryptographicHash::Sha256, macKey_};
+    mac.addData(pidTag);
+    mac.addData(nonce);
+    mac.addData(cipherText);
+    return mac.result();
+}
+
+bool MlDiskCache::readRecordAt(qint64 offset, QByteArray& tag, QByteArray& plainText)
+{
+    if (!file_.seek(offset))
+        return false;
+
+    const auto header = file_.read(4 + PidTagSize + NonceSize);
+    if (header.size() != 4 + PidTagSize + NonceSize)
+        return false;
+
+    const auto payloadSize = qFromBigEndian<quint32>(header.constData());
+    tag = header.mid(4, PidTagSize);
+    const auto nonce = header.mid(4 + PidTagSize, NonceSize);
+
+    const auto cipherText = file_.read(payloadSize);
+    const auto storedAuthTag = file_.read(AuthTagSize);
+    if (cipherText.size() != static_cast<qsizetype>(payloadSize) || storedAuthTag.size() != AuthTagSize)
+        return false;
+
+    if (authTag(tag, nonce, cipherText) != storedAuthTag)
+    {
+        qCWarning(MLC_LOG_CAT) << "Record cache" << fileName_ << "contains a record failing authentication";
+        return false;
+    }
+
+    plainText = crypt(nonce, cipherText);
+    return true;
+}
+
+void MlDiskCache::appendRecord(const QByteArray& tag, const QByteArray& plainText)
+{
+    const auto nonce = randomBytes(NonceSize);
+    const auto cipherText = crypt(nonce, plainText);
+
+    QByteArray data(4, Qt::Uninitialized);
+    qToBigEndian(static_cast<quint32>(cipherText.size()), data.data());
+    data += tag;
+    data += nonce;
+    data += cipherText;
+    data += authTag(tag, nonce, cipherText);
+
+    const auto offset = file_.size();
+    if (!file_.seek(offset) || file_.write(data) != data.size() || !file_.flush())
+    {
+        qCWarning(MLC_LOG_CAT) << "Failed to write record cache" << fileName_ << ":" << file_.errorString();
+        return;
+    }
+
+    const bool replaced = index_.contains(tag);
+    if (plainText.isEmpty())
+        index_.remove(tag);
+    else
+        index_.insert(tag, offset);
+
+    // The superseded record and, for removals, the marker itself
+    deadRecords_ += (replaced ? 1 : 0) + (plainText.isEmpty() ? 1 : 0);
+}
+
+bool MlDiskCache::writeHeader(QIODevice& device) const
+{
+    QByteArray header(6, Qt::Uninitialized);
+    qToBigEndian(FileMagic, header.data());
+    qToBigEndian(FileVersion, header.data() + 4);
+    header += hmac(macKey_, QByteArrayLiteral("key check"));
+
+    return device.write(header) == header.size();
+}
+
+bool MlDiskCache::readIndex()
+{
+    if (!file_.seek(0))
+        return false;
+
+    const auto header = file_.read(HeaderSize);
+    if (header.size() != HeaderSize || qFromBigEndian<quint32>(header.constData()) != FileMagic ||
+            qFromBigEndian<quint16>(header.constData() + 4) > FileVersion)
+    {
+        qCWarning(MLC_LOG_CAT) << "Record cache" << fileName_ << "is not valid, discarding it";
+        return false;
+    }
+
+    if (header.mid(6) != hmac(macKey_, QByteArrayLiteral("key check")))
+    {
+        qCWarning(MLC_LOG_CAT) << "Record cache" << fileName_ << "was written with another key, discarding it";
+        return false;
+    }
+
+    index_.clear();
+    deadRecords_ = 0;
+
+    qint64 offset = HeaderSize;
+    const auto fileSize = file_.size();
+
+    while (offset + RecordOverhead <= fileSize)
+    {
+        if (!file_.seek(offset))
+            return false;
+
+        const auto recordHeader = file_.read(4 + PidTagSize);
+        const auto payloadSize = qFromBigEndian<quint32>(recordHeader.constData());
+        const auto next = offset + RecordOverhead + payloadSize;
+        if (next > fileSize)
+            break;
+
+        const auto tag = recordHeader.mid(4, PidTagSize);
+        const bool replaced = index_.contains(tag);
+        if (payloadSize == 0)
+            index_.remove(tag);
+        else
+            index_.insert(tag, offset);
+        deadRecords_ += (replaced ? 1 : 0) + (payloadSize == 0 ? 1 : 0);
+
+        offset = next;
+    }
+
+    // A session which crashed while writing leaves a truncated last record
+    if (offset != fileSize)
+        file_.resize(offset);
+
+    return true;
+}
+
+void MlDiskCache::compactIfNeeded()
+{
+    if (deadRecords_ < MinDeadRecordsForCompaction || deadRecords_ < index_.size())
+        return;
+
+    QSaveFile out{fileName_};
+    if (!out.open(QIODevice::WriteOnly) || !writeHeader(out))
+    {
+        qCWarning(MLC_LOG_CAT) << "Failed to compact record cache" << fileName_ << ":" << out.errorString();
+        return;
+    }
+
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    QHash<QByteArray, qint64> index;
+    qint64 offset = HeaderSize;
+
+    for (auto it = index_.cbegin(); it != index_.cend(); ++it)
+    {
+        if (!file_.seek(it.value()))
+            continue;
+
+        const auto header = file_.read(4);
+        if (header.size() != 4)
+            continue;
+        const auto size = RecordOverhead + qFromBigEndian<quint32>(header.constData());
+
+        // Expired records are dropped instead of copied
+        QByteArray tag;
+        QByteArray plainText;
+        QString pid;
+        Record record;
+        if (!readRecordAt(it.value(), tag, plainText) || !deserialize(plainText, pid, record) ||
+                isExpired(record, now))
+            continue;
+
+        file_.seek(it.value());
+        const auto data = file_.read(size);
+        if (data.size() != size || out.write(data) != size)
+            continue;
+
+        index.insert(it.key(), offset);
+        offset += size;
+    }
+
+    file_.close();
+    if (!out.commit())
+    {
+        qCWarning(MLC_LOG_CAT) << "Failed to compact record cache" << fileName_ << ":" << out.errorString();
+        file_.open(QIODevice::ReadWrite);
+        return;
+    }
+
+    if (!file_.open(QIODevice::ReadWrite))
+    {
+        qCWarning(MLC_LOG_CAT) << "Failed to reopen record cache" << fileName_ << ":" << file_.errorString();
+        index_.clear();
+        return;
+    }
+
+    index_ = std::move(index);
+    deadRecords_ = 0;
+}
+
+bool MlDiskCache::isExpired(const Record& record, qint64 now) const
+{
+    return now - record.seenMs > ttlMs_;
+}
@@ -0,0 +1,82 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// Persistent, encrypted store of patient field values, used as backing store of the MlRecordCache.
+//
+// The file is append only: every write adds a record, the in-memory index points to the latest record of each PID
+// and the file is compacted once most records are superseded. PIDs are only stored as keyed hashes in the record
+// headers and inside the encrypted payload.
+//
+// Qt has no block cipher, so records are encrypted with HMAC-SHA256 in counter mode and authenticated with a
+// separate HMAC-SHA256 tag (encrypt then MAC). Both keys are derived from the 32 byte master key.
+class MlDiskCache
+{
+public:
+    struct Value
+    {
+        QString value{};
+        bool present{};
+        qint64 fetchedMs{};
+    };
+
+    // Times are milliseconds since epoch
+    struct Record
+    {
+        qint64 seenMs{};
+        QHash<QString, Value> fields{};
+    };
+
+    static constexpr qsizetype KeySize = 32;
+    static constexpr qint64 DefaultTtlMs = 24 * 60 * 60 * 1000;
+
+public:
+    MlDiskCache(QString fileName, const QByteArray& key);
+    ~MlDiskCache();
+
+    // Opens the file and reads its index. A file written with another key is discarded.
+    bool open();
+    QString errorString() const { return errorString_; }
+    QString fileName() const { return fileName_; }
+
+    qint64 ttl() const { return ttlMs_; }
+    void setTtl(qint64 ms) { ttlMs_ = ms; }
+
+    bool read(const QString& pid, Record& record);
+    void write(const QString& pid, const Record& record);
+    void remove(const QString& pid);
+    // Deletes all records and the file
+    void purge();
+
+    qsizetype size() const { return index_.size(); }
+
+    static QByteArray generateKey();
+
+private:
+    QByteArray pidTag(const QString& pid) const;
+    QByteArray crypt(const QByteArray& nonce, const QByteArray& data) const;
+    QByteArray authTag(const QByteArray& pidTag, const QByteArray& nonce, const QByteArray& cipherText) const;
+
+    bool readRecordAt(qint64 offset, QByteArray& tag, QByteArray& plainText);
+    void appendRecord(const QByteArray& tag, const QByteArray& plainText);
+    bool writeHeader(QIODevice& device) const;
+    bool readIndex();
+    void compactIfNeeded();
+    bool isExpired(const Record& record, qint64 now) const;
+
+private:
+    QString fileName_;
+    QByteArray encKey_;
+    QByteArray macKey_;
+    QFile file_;
+    QHash<QByteArray, qint64> index_;
+    qsizetype deadRecords_{};
+    qint64 ttlMs_{DefaultTtlMs};
+    QString errorString_;
+};
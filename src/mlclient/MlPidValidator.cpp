@@ -0,0 +1,132 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlPidValidator.h"
+
+#include <array>
+
+namespace {
+
+constexpr char PidAlphabet[] = "0123456789ACDEFGHJKLMNPQRTUVWXYZ";
+constexpr qsizetype PidLength = 8;
+constexpr qsizetype CheckedLength = PidLength - 2;
+
+constexpr std::array<qint8, 128> makeDecodeTable()
+{
+    std::array<qint8, 128> table{};
+    for (auto& v : table)
+        v = -1;
+    for (int i = 0; i < 32; ++i)
+        table[static_cast<size_t>(PidAlphabet[i])] = static_cast<qint8>(i);
+    return table;
+}
+
+constexpr auto DecodeTable = makeDecodeTable();
+
+int decode(QChar c)
+{
+    return c.unicode() < DecodeTable.size() ? DecodeTable[c.unicode()] : -1;
+}
+
+// Multiplication by x in GF(32) = GF(2)[x] / (x^5 + x^2 + 1)
+int timesX(int n)
+{
+    n <<= 1;
+    return (n & 32) ? n ^ 37 : n;
+}
+
+} // namespace
+
+const QString MlPidValidator::DefaultFormat = QStringLiteral("[0-9ACDEFGHJKLMNPQRTUVWXYZ]{8}");
+
+MlPidValidator::MlPidValidator(const QString& format, bool checkCharacters) :
+    format_{QRegularExpression::anchoredPattern(format)},
+    acceptAll_{format.isEmpty()},
+    checkCharacters_{checkCharacters}
+{
+    format_.optimize();
+}
+
+MlPidValidator::Result MlPidValidator::check(const QString& input) const
+{
+    auto pid = input.trimmed();
+    if (pid.isEmpty())
+        return {};
+
+    if (accepts(pid))
+        return {pid, true};
+
+    pid = pid.toUpper();
+    if (accepts(pid))
+        return {pid, true};
+
+    return {};
+}
+
+QList<MlPidValidator::Result> MlPidValidator::checkAll(const QStringList& inputs) const
+{
+    QList<Result> results;
+    results.reserve(inputs.size());
+
+    for (const auto& input : inputs)
+    {
+        results << check(input);
+    }
+
+    return results;
+}
+
+// Read as elements of GF(32), the characters p0 .. p7 of a valid PID sum up to 0 and so does p0 x^7 + ... + p7. Any
+// single wrong character changes the first sum, any swap of two different neighbours the second.
+bool MlPidValidator::hasValidCheckCharacters(const QString& pid)
+{
+    if (pid.size() != PidLength)
+        return false;
+
+    int sum = 0;
+    int weighted = 0;
+    for (const auto c : pid)
+    {
+        const auto value = decode(c);
+        if (value < 0)
+            return false;
+        sum ^= value;
+        weighted = timesX(weighted) ^ value;
+    }
+    return sum == 0 && weighted == 0;
+}
+
+QString MlPidValidator::withCheckCharacters(const QString& pid)
+{
+    if (pid.size() != CheckedLength)
+        return {};
+
+    int sum = 0;
+    int weighted = 0;
+    for (const auto c : pid)
+    {
+        const auto value = decode(c);
+        if (value < 0)
+            return {};
+        sum ^= value;
+        weighted = timesX(weighted) ^ value;
+    }
+
+    // Check characters c0 and c1 solve c0 + c1 = sum and c0 x + c1 = weighted x^2, so (x + 1) c0 = sum + weighted x^2
+    const auto target = sum ^ timesX(timesX(weighted));
+    int first = 0;
+    while ((timesX(first) ^ first) != target)
+        ++first;
+    const auto second = sum ^ first;
+
+    return pid + QLatin1Char(PidAlphabet[first]) + QLatin1Char(PidAlphabet[second]);
+}
+
+bool MlPidValidator::accepts(const QString& pid) const
+{
+    // An invalid format would reject everything, treat it like no format
+    if (!acceptAll_ && format_.isValid() && !format_.match(pid).hasMatch())
+        return false;
+
+    return !checkCharacters_ || hasValidCheckCharacters(pid);
+}
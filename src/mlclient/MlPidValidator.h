@@ -0,0 +1,49 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+// Normalizes PIDs from user input and rejects the ones which cannot be valid, so they are never sent. A malformed
+// PID fails the whole read it is part of on the server.
+//
+// Input is trimmed and uppercased if it matches the format only that way. An empty format accepts any non-empty PID.
+// Optionally the two check characters the Mainzelliste PID generator appends are verified, which catches typos.
+class MlPidValidator
+{
+public:
+    // Eight characters of the default Mainzelliste PID alphabet
+    static const QString DefaultFormat;
+
+    struct Result
+    {
+        // Normalized PID, empty for invalid input
+        QString pid{};
+        bool valid{};
+    };
+
+public:
+    explicit MlPidValidator(const QString& format = DefaultFormat, bool checkCharacters = false);
+
+    bool isFormatValid() const { return format_.isValid(); }
+    QString formatError() const { return format_.errorString(); }
+
+    Result check(const QString& input) const;
+    QList<Result> checkAll(const QStringList& inputs) const;
+
+    static bool hasValidCheckCharacters(const QString& pid);
+    // Appends the check characters to the first six characters of a PID, empty if they are not from the PID alphabet
+    static QString withCheckCharacters(const QString& pid);
+
+private:
+    bool accepts(const QString& pid) const;
+
+private:
+    QRegularExpression format_;
+    bool acceptAll_{};
+    bool checkCharacters_{};
+};
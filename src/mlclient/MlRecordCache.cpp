@@ -0,0 +1,252 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlRecordCache.h"
+
+#include <QDateTime>
+#include <QSet>
+#include <memory>
+
+namespace {
+
+void addToFetch(QList<MlRecordCache::Fetch>& fetches, QHash<QString, qsizetype>& fetchByFields,
+                const QString& pid, const QStringList& fields)
+{
+    auto& index = fetchByFields[fields.join(QLatin1Char('\n'))];
+    if (index == 0)
+    {
+        fetches << MlRecordCache::Fetch{{}, fields};
+        index = fetches.size();
+    }
+    fetches[index - 1].pids << pid;
+}
+
+} // namespace
+
+MlRecordCache::MlRecordCache() :
+    entries_{DefaultBudgetBytes}
+{
+}
+
+MlRecordCache::Plan MlRecordCache::plan(const QStringList& pids, const QStringList& fields)
+{
+    Plan plan;
+    plan.plannedMs = now();
+
+    QHash<QString, qsizetype> fetchByMissing;
+    QHash<QString, qsizetype> revalidationByStale;
+    QSet<QString> seen;
+
+    for (const auto& pid : pids)
+    {
+        if (seen.contains(pid))
+            continue;
+        seen.insert(pid);
+
+        const auto unknown = unknownMs_.constFind(pid);
+        if (unknown != unknownMs_.cend())
+        {
+            const auto age = plan.plannedMs - unknown.value();
+            if (age <= negativeTtlMs_)
+            {
+                ++stats_.unknownHits;
+                plan.unknown << pid;
+                if (age > ttlMs_)
+                    addToFetch(plan.revalidations, revalidationByStale, pid, {});
+                continue;
+            }
+        }
+
+        const auto entry = lookup(pid);
+        const auto entryAge = entry ? ageOf(entry->seenMs, plan.plannedMs) : Age::Expired;
+        if (entryAge == Age::Expired)
+        {
+            ++stats_.misses;
+            addToFetch(plan.fetches, fetchByMissing, pid, fields);
+            continue;
+        }
+
+        Record record;
+        QStringList missing;
+        QStringList stale;
+        for (const auto& field : fields)
+        {
+            const auto it = entry->fields.constFind(field);
+            const auto age = it != entry->fields.cend() ? ageOf(it->fetchedMs, plan.plannedMs) : Age::Expired;
+            if (age == Age::Expired)
+            {
+                missing << field;
+                continue;
+            }
+
+            if (age == Age::Stale || entryAge == Age::Stale)
+                stale << field;
+            if (it->present)
+                record.insert(field, it->value);
+        }
+
+        plan.cached.insert(pid, record);
+
+        if (!stale.isEmpty() || (entryAge == Age::Stale && fields.isEmpty()))
+            addToFetch(plan.revalidations, revalidationByStale, pid, stale);
+
+        if (missing.isEmpty())
+        {
+            ++stats_.hits;
+            continue;
+        }
+
+        ++stats_.partialHits;
+        addToFetch(plan.fetches, fetchByMissing, pid, missing);
+    }
+
+    return plan;
+}
+
+void MlRecordCache::insert(const QString& pid, const Record& record, const QStringList& fields, qint64 plannedMs)
+{
+    const auto invalidated = invalidatedMs_.constFind(pid);
+    if (invalidated != invalidatedMs_.cend() && plannedMs <= invalidated.value())
+        return;
+
+    unknownMs_.remove(pid);
+
+    std::unique_ptr<Entry> entry{entries_.take(pid)};
+    if (!entry)
+        entry.reset(new Entry{});
+
+    const auto timestamp = now();
+    entry->seenMs = timestamp;
+
+    for (const auto& field : fields)
+    {
+        const auto it = record.constFind(field);
+        const bool present = it != record.cend();
+        entry->fields.insert(field, MlDiskCache::Value{present ? it.value() : QString{}, present, timestamp});
+    }
+
+    if (store_)
+        store_->write(pid, *entry);
+
+    const auto cost = costOf(pid, *entry);
+    entries_.insert(pid, entry.release(), cost);
+}
+
+void MlRecordCache::invalidate(const QString& pid)
+{
+    entries_.remove(pid);
+    unknownMs_.remove(pid);
+
+    // Reads planned more than a TTL ago are long finished, their invalidations are not needed anymore. Pruned only
+    // when the hash doubled, so invalidating stays cheap.
+    const auto timestamp = now();
+    if (invalidatedMs_.size() >= invalidatedPruneSize_)
+    {
+        const auto keepMs = qMax(ttlMs_, MinInvalidationKeepMs);
+        invalidatedMs_.removeIf([timestamp, keepMs](const auto& it) { return timestamp - it.value() > keepMs; });
+        invalidatedPruneSize_ = qMax(MinInvalidatedPruneSize, 2 * invalidatedMs_.size());
+    }
+    invalidatedMs_.insert(pid, timestamp);
+
+    if (store_)
+        store_->remove(pid);
+}
+
+void MlRecordCache::markUnknown(const QString& pid, qint64 plannedMs)
+{
+    const auto invalidated = invalidatedMs_.constFind(pid);
+    if (invalidated != invalidatedMs_.cend() && plannedMs <= invalidated.value())
+        return;
+
+    entries_.remove(pid);
+    if (store_)
+        store_->remove(pid);
+
+    if (negativeTtlMs_ <= 0)
+        return;
+
+    const auto timestamp = now();
+    if (unknownMs_.size() >= MaxUnknownPids)
+    {
+        unknownMs_.removeIf([this, timestamp](const auto& it) { return timestamp - it.value() > negativeTtlMs_; });
+        if (unknownMs_.size() >= MaxUnknownPids)
+            unknownMs_.clear();
+    }
+    unknownMs_.insert(pid, timestamp);
+}
+
+void MlRecordCache::clear()
+{
+    entries_.clear();
+    invalidatedMs_.clear();
+    unknownMs_.clear();
+}
+
+bool MlRecordCache::contains(const QString& pid, const QStringList& fields) const
+{
+    const auto now = MlRecordCache::now();
+
+    const auto unknown = unknownMs_.constFind(pid);
+    if (unknown != unknownMs_.cend() && now - unknown.value() <= negativeTtlMs_)
+        return true;
+
+    const auto entry = entries_.object(pid);
+    if (!entry || ageOf(entry->seenMs, now) == Age::Expired)
+        return false;
+
+    for (const auto& field : fields)
+    {
+        const auto it = entry->fields.constFind(field);
+        if (it == entry->fields.cend() || ageOf(it->fetchedMs, now) == Age::Expired)
+            return false;
+    }
+    return true;
+}
+
+qint64 MlRecordCache::now()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+MlRecordCache::Entry* MlRecordCache::lookup(const QString& pid)
+{
+    if (auto entry = entries_.object(pid))
+        return entry;
+
+    if (!store_)
+        return nullptr;
+
+    auto entry = std::make_unique<Entry>();
+    if (!store_->read(pid, *entry))
+        return nullptr;
+
+    ++stats_.storeHits;
+
+    const auto cost = costOf(pid, *entry);
+    if (!entries_.insert(pid, entry.release(), cost))
+        return nullptr;
+    return entries_.object(pid);
+}
+
+MlRecordCache::Age MlRecordCache::ageOf(qint64 fetchedMs, qint64 now) const
+{
+    const auto age = now - fetchedMs;
+    if (age <= ttlMs_)
+        return Age::Fresh;
+    if (age <= staleTtlMs_)
+        return Age::Stale;
+    return Age::Expired;
+}
+
+qsizetype MlRecordCache::costOf(const QString& pid, const Entry& entry)
+{
+    // Rough heap usage: UTF-16 strings plus hash node overhead
+    constexpr qsizetype nodeOverhead = 48;
+
+    qsizetype cost = nodeOverhead + pid.size() * 2;
+    for (auto it = entry.fields.cbegin(); it != entry.fields.cend(); ++it)
+    {
+        cost += nodeOverhead + (it.key().size() + it->value.size()) * 2;
+    }
+    return cost;
+}
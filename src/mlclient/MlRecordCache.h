@@ -0,0 +1,130 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlDiskCache.h"
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+// Field values of patients by PID. Every field has its own age, so a load can request only the fields which are
+// missing or stale. The least recently used patients are evicted once the size budget is exceeded.
+//
+// With a store attached, patients not in memory are looked up in the store and all fetched values are written
+// through to it. Values older than the TTL but within the stale TTL are served anyway and reported for background
+// revalidation.
+//
+// PIDs the server did not return are remembered as unknown for the negative TTL and left out of the fetches. Once
+// they are older than the TTL they are checked again in the background only.
+class MlRecordCache
+{
+public:
+    using Record = QHash<QString, QString>;
+
+    // One read needed to complete a load, all PIDs of a fetch miss the same fields
+    struct Fetch
+    {
+        QStringList pids{};
+        QStringList fields{};
+    };
+
+    struct Plan
+    {
+        // Values already known, by PID. Contains PIDs which are partially fetched too.
+        QHash<QString, Record> cached{};
+        QList<Fetch> fetches{};
+        // Served from the cache although stale, to be read again in the background
+        QList<Fetch> revalidations{};
+        // Known not to exist, neither served nor fetched
+        QStringList unknown{};
+        qint64 plannedMs{};
+    };
+
+    struct Stats
+    {
+        int hits{};
+        int partialHits{};
+        int misses{};
+        int storeHits{};
+        int unknownHits{};
+    };
+
+    static constexpr qint64 DefaultTtlMs = 5 * 60 * 1000;
+    static constexpr qsizetype DefaultBudgetBytes = 64 * 1024 * 1024;
+    static constexpr qint64 DefaultNegativeTtlMs = 60 * 60 * 1000;
+    static constexpr qsizetype MaxUnknownPids = 100000;
+
+public:
+    MlRecordCache();
+
+    qint64 ttl() const { return ttlMs_; }
+    void setTtl(qint64 ms) { ttlMs_ = ms; }
+
+    // 0 means no stale values are served
+    qint64 staleTtl() const { return staleTtlMs_; }
+    void setStaleTtl(qint64 ms) { staleTtlMs_ = ms; }
+
+    // 0 disables the negative cache
+    qint64 negativeTtl() const { return negativeTtlMs_; }
+    void setNegativeTtl(qint64 ms) { negativeTtlMs_ = ms; }
+
+    qsizetype budget() const { return entries_.maxCost(); }
+    void setBudget(qsizetype bytes) { entries_.setMaxCost(bytes); }
+
+    const QSharedPointer<MlDiskCache>& store() const { return store_; }
+    void setStore(const QSharedPointer<MlDiskCache>& store) { store_ = store; }
+
+    Plan plan(const QStringList& pids, const QStringList& fields);
+    // Whether a plan would serve all fields of the PID from memory, the store and the stats are left alone
+    bool contains(const QString& pid, const QStringList& fields) const;
+    // Values read for a plan, fields requested but not delivered by the server are remembered as absent
+    void insert(const QString& pid, const Record& record, const QStringList& fields, qint64 plannedMs);
+    void invalidate(const QString& pid);
+    // A PID requested by a read planned at plannedMs but not returned by the server
+    void markUnknown(const QString& pid, qint64 plannedMs);
+    // Clears the memory only, the store keeps its records
+    void clear();
+
+    Stats stats() const { return stats_; }
+    qsizetype size() const { return entries_.size(); }
+    qsizetype unknownCount() const { return unknownMs_.size(); }
+    qsizetype usedBytes() const { return entries_.totalCost(); }
+
+    static qint64 now();
+
+private:
+    using Entry = MlDiskCache::Record;
+
+    static constexpr qsizetype MinInvalidatedPruneSize = 1024;
+    // Longer than any read runs, even with a shorter TTL
+    static constexpr qint64 MinInvalidationKeepMs = 10 * 60 * 1000;
+
+    enum class Age
+    {
+        Fresh,
+        Stale,
+        Expired,
+    };
+
+private:
+    Entry* lookup(const QString& pid);
+    Age ageOf(qint64 fetchedMs, qint64 now) const;
+    static qsizetype costOf(const QString& pid, const Entry& entry);
+
+private:
+    QCache<QString, Entry> entries_;
+    // Time of the last edit per PID, reads planned before it must not bring back old values
+    QHash<QString, qint64> invalidatedMs_;
+    qsizetype invalidatedPruneSize_{MinInvalidatedPruneSize};
+    // Time PIDs were last found missing on the server
+    QHash<QString, qint64> unknownMs_;
+    qint64 negativeTtlMs_{DefaultNegativeTtlMs};
+    qint64 ttlMs_{DefaultTtlMs};
+    qint64 staleTtlMs_{};
+    QSharedPointer<MlDiskCache> store_;
+    Stats stats_{};
+};
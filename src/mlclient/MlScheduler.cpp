@@ -0,0 +1,129 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlScheduler.h"
+
+#include <algorithm>
+
+MlScheduler::MlScheduler()
+{
+    clock_.start();
+}
+
+void MlScheduler::submit(Priority priority, const void* flow, QObject* job, std::function<void()> start)
+{
+    auto& queue = queues_[index(priority)];
+
+    auto it = std::find_if(queue.flows.begin(), queue.flows.end(), [flow](const Flow& f) { return f.id == flow; });
+    if (it == queue.flows.end())
+    {
+        queue.flows << Flow{flow, {}};
+        it = std::prev(queue.flows.end());
+    }
+
+    it->entries << Entry{job, std::move(start), clock_.elapsed()};
+    ++queue.stats.queued;
+
+    dispatch();
+}
+
+void MlScheduler::release(QObject* job)
+{
+    const auto runningIt = running_.find(job);
+    if (runningIt != running_.end())
+    {
+        --queues_[index(runningIt.value())].stats.running;
+        running_.erase(runningIt);
+        dispatch();
+        return;
+    }
+
+    for (auto& queue : queues_)
+    {
+        for (auto flowIt = queue.flows.begin(); flowIt != queue.flows.end(); ++flowIt)
+        {
+            const auto removed = flowIt->entries.removeIf([job](const Entry& e) { return e.job == job; });
+            if (removed == 0)
+                continue;
+
+            queue.stats.queued -= static_cast<int>(removed);
+            if (flowIt->entries.isEmpty())
+                queue.flows.erase(flowIt);
+            return;
+        }
+    }
+}
+
+QString MlScheduler::priorityName(Priority priority)
+{
+    switch (priority)
+    {
+        case Priority::Interactive:
+            return QStringLiteral("interactive");
+        case Priority::Bulk:
+            return QStringLiteral("bulk");
+        case Priority::Background:
+            return QStringLiteral("background");
+        case Priority::_Count:
+            break;
+    }
+
+    Q_UNREACHABLE();
+}
+
+void MlScheduler::dispatch()
+{
+    constexpr int sharedCapacity = MaxConcurrent - ReservedInteractive;
+
+    while (running_.size() < MaxConcurrent)
+    {
+        const bool interactive = !queues_[index(Priority::Interactive)].flows.isEmpty();
+        const bool bulk = !queues_[index(Priority::Bulk)].flows.isEmpty();
+        const bool background = !queues_[index(Priority::Background)].flows.isEmpty();
+
+        if (interactive)
+        {
+            startNext(Priority::Interactive);
+            continue;
+        }
+
+        const auto sharedRunning = queues_[index(Priority::Bulk)].stats.running +
+                queues_[index(Priority::Background)].stats.running;
+        if (sharedRunning >= sharedCapacity || (!bulk && !background))
+            break;
+
+        if (bulk && background)
+        {
+            const bool bulkTurn = sharedTurn_ % (BulkWeight + BackgroundWeight) < BulkWeight;
+            ++sharedTurn_;
+            startNext(bulkTurn ? Priority::Bulk : Priority::Background);
+        }
+        else
+        {
+            startNext(bulk ? Priority::Bulk : Priority::Background);
+        }
+    }
+}
+
+void MlScheduler::startNext(Priority priority)
+{
+    auto& queue = queues_[index(priority)];
+    Q_ASSERT(!queue.flows.isEmpty());
+
+    // Round robin: take from the first flow and move it to the back
+    auto flow = queue.flows.takeFirst();
+    auto entry = flow.entries.takeFirst();
+    if (!flow.entries.isEmpty())
+        queue.flows << std::move(flow);
+
+    const auto waitMs = clock_.elapsed() - entry.enqueuedMs;
+
+    --queue.stats.queued;
+    ++queue.stats.running;
+    ++queue.stats.started;
+    queue.stats.totalWaitMs += waitMs;
+    queue.stats.maxWaitMs = qMax(queue.stats.maxWaitMs, waitMs);
+
+    running_.insert(entry.job, priority);
+    entry.start();
+}
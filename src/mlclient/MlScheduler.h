@@ -0,0 +1,91 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <array>
+#include <functional>
+
+class QObject;
+
+// Limits the requests running concurrently against one endpoint and decides which waiting request runs next.
+//
+// Interactive requests always go first and have slots reserved for them, so a lookup in the editor never waits
+// behind a queue of bulk batches. Bulk and background requests share the remaining slots by weight. Within a class
+// every flow (usually one client) gets its turn in round robin, so one big load cannot starve another.
+class MlScheduler
+{
+public:
+    enum class Priority
+    {
+        Interactive,
+        Bulk,
+        Background,
+        _Count
+    };
+
+    struct QueueStats
+    {
+        int queued{};
+        int running{};
+        int started{};
+        qint64 totalWaitMs{};
+        qint64 maxWaitMs{};
+
+        qint64 averageWaitMs() const { return started > 0 ? totalWaitMs / started : 0; }
+    };
+
+    // Matches the number of connections QNetworkAccessManager opens per host
+    static constexpr int MaxConcurrent = 6;
+    static constexpr int ReservedInteractive = 2;
+    static constexpr int BulkWeight = 3;
+    static constexpr int BackgroundWeight = 1;
+
+public:
+    MlScheduler();
+
+    // Queues a job, start is called once it may run. The job occupies its slot until it is released.
+    void submit(Priority priority, const void* flow, QObject* job, std::function<void()> start);
+    // Frees the slot of a running job or drops it from the queue if it did not start yet
+    void release(QObject* job);
+
+    QueueStats stats(Priority priority) const { return queues_[index(priority)].stats; }
+
+    static QString priorityName(Priority priority);
+
+private:
+    struct Entry
+    {
+        QObject* job{};
+        std::function<void()> start{};
+        qint64 enqueuedMs{};
+    };
+
+    struct Flow
+    {
+        const void* id{};
+        QList<Entry> entries{};
+    };
+
+    struct Queue
+    {
+        QList<Flow> flows{};
+        QueueStats stats{};
+    };
+
+private:
+    static qsizetype index(Priority priority) { return static_cast<qsizetype>(priority); }
+
+    void dispatch();
+    void startNext(Priority priority);
+
+private:
+    std::array<Queue, static_cast<size_t>(Priority::_Count)> queues_{};
+    QHash<QObject*, Priority> running_;
+    int sharedTurn_{};
+    QElapsedTimer clock_;
+};
@@ -10,6 +10,86 @@
 
 namespace {
 
+// Token with more search IDs than this are streamed to the server instead of being built in memory
+constexpr qsizetype StreamedTokenThreshold = 5000;
+constexpr qsizetype StreamedTokenChunkSize = 1000;
+
+QByteArray jsonString(const QString& string)
+{
+    QByteArray out;
+    out.reserve(string.size() + 2);
+    out += '"';
+    for (const auto c : string.toUtf8())
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    out += "\\u00";
+                    out += QByteArray::number(static_cast<int>(c), 16).rightJustified(2, '0');
+                }
+                else
+                    out += c;
+                break;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+QByteArray jsonPidObject(const QString& pid)
+{
+    return QByteArray{"{\"idType\":\"pid\",\"idString\":"} + jsonString(pid) + '}';
+}
+
+const auto IdFieldPrefix = QStringLiteral("id:");
+
+// Splits result fields into the ID types (PID always first) and the fields to read
+void splitResultFields(const QStringList& resultFields, QStringList& idTypes, QStringList& fields)
+{
+    idTypes = QStringList{"pid"_l1};
+    fields.clear();
+    for (const auto& field : resultFields)
+    {
+        const auto idType = idTypeOfField(field);
+        if (idType.isEmpty())
+            fields << field;
+        else if (!idTypes.contains(idType))
+            idTypes << idType;
+    }
+}
+
+QByteArray jsonStringList(const QStringList& strings)
+{
+    QByteArray out;
+    for (qsizetype i = 0; i < strings.size(); ++i)
+    {
+        if (i > 0)
+            out += ',';
+        out += jsonString(strings[i]);
+    }
+    return out;
+}
+
+constexpr char ReadTokenPrefix[] = "{\"type\":\"readPatients\",\"data\":{\"searchIds\":[";
+
+QByteArray readTokenSuffix(const QStringList& resultFields)
+{
+    QStringList idTypes;
+    QStringList fields;
+    splitResultFields(resultFields, idTypes, fields);
+
+    return "],\"resultIds\":[" + jsonStringList(idTypes) + "],\"resultFields\":[" + jsonStringList(fields) + "]}}";
+}
+
 QJsonObject makePidObject(const QString& pid)
 {
     QJsonObject id;
@@ -30,13 +110,28 @@ QJsonArray makePidList(const QStringList& pids)
 
 } // namespace
 
-QJsonObject makeReadPatientToken(const QVersionNumber& apiVersion, const QStringList& pids, const QStringList& fields)
+QString idTypeField(const QString& idType)
+{
+    return IdFieldPrefix + idType;
+}
+
+QString idTypeOfField(const QString& field)
+{
+    return field.startsWith(IdFieldPrefix) ? field.mid(IdFieldPrefix.size()) : QString{};
+}
+
+QJsonObject makeReadPatientToken(const QVersionNumber& apiVersion, const QStringList& pids,
+                                 const QStringList& resultFields)
 {
     Q_UNUSED(apiVersion)
 
+    QStringList idTypes;
+    QStringList fields;
+    splitResultFields(resultFields, idTypes, fields);
+
     QJsonObject data;
     data["searchIds"_l1] = makePidList(pids);
-    data["resultIds"_l1] = QJsonArray({"pid"_l1});
+    data["resultIds"_l1] = QJsonArray::fromStringList(idTypes);
     data["resultFields"_l1] = QJsonArray::fromStringList(fields);
 
     QJsonObject token;
@@ -46,6 +141,59 @@ QJsonObject makeReadPatientToken(const QVersionNumber& apiVersion, const QString
     return token;
 }
 
+HttpBody makeReadPatientTokenBody(const QVersionNumber& apiVersion, const QStringList& pids, const QStringList& fields)
+{
+    if (pids.size() <= StreamedTokenThreshold)
+        return HttpBody::fromJson(makeReadPatientToken(apiVersion, pids, fields));
+
+    const QByteArray prefix{ReadTokenPrefix};
+    const auto suffix = readTokenSuffix(fields);
+
+    // The size has to be known before the first byte is sent, so the ID list is measured without keeping it
+    qint64 size = prefix.size() + suffix.size() + (pids.size() - 1);
+    for (const auto& pid : pids)
+    {
+        size += jsonPidObject(pid).size();
+    }
+
+    const auto chunkCount = static_cast<int>((pids.size() + StreamedTokenChunkSize - 1) / StreamedTokenChunkSize);
+
+    auto generator = [pids, prefix, suffix, chunkCount](int chunkIndex) -> QByteArray
+    {
+        if (chunkIndex == 0)
+            return prefix;
+        if (chunkIndex == chunkCount + 1)
+            return suffix;
+        if (chunkIndex > chunkCount + 1)
+            return {};
+
+        const auto begin = (chunkIndex - 1) * StreamedTokenChunkSize;
+        const auto end = qMin(begin + StreamedTokenChunkSize, pids.size());
+
+        QByteArray chunk;
+        for (auto i = begin; i < end; ++i)
+        {
+            if (i > 0)
+                chunk += ',';
+            chunk += jsonPidObject(pids[i]);
+        }
+        return chunk;
+    };
+
+    return HttpBody::fromGenerator(QStringLiteral("application/json"), size, generator);
+}
+
+qint64 readPatientTokenBaseSize(const QStringList& fields)
+{
+    return static_cast<qint64>(qstrlen(ReadTokenPrefix)) + readTokenSuffix(fields).size();
+}
+
+qint64 readPatientTokenIdSize(const QString& pid)
+{
+    // Separating comma included
+    return jsonPidObject(pid).size() + 1;
+}
+
 QJsonObject makeCreatePatientToken(const QVersionNumber& apiVersion)
 {
     Q_UNUSED(apiVersion)
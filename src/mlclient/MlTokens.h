@@ -3,11 +3,21 @@
 
 #pragma once
 
+#include "HttpBody.h"
 #include <QStringList>
 #include <QVersionNumber>
 
 class QJsonObject;
 
+// Result fields of the form "id:<type>" request an ID type instead of a field, read in the same pass as the fields
+QString idTypeField(const QString& idType);
+// The ID type requested by a result field, empty for regular fields
+QString idTypeOfField(const QString& field);
+
 QJsonObject makeReadPatientToken(const QVersionNumber& apiVersion, const QStringList& pids, const QStringList& fields);
+HttpBody makeReadPatientTokenBody(const QVersionNumber& apiVersion, const QStringList& pids, const QStringList& fields);
+// Serialized size of a read token without search IDs, and what each search ID adds to it
+qint64 readPatientTokenBaseSize(const QStringList& fields);
+qint64 readPatientTokenIdSize(const QString& pid);
 QJsonObject makeCreatePatientToken(const QVersionNumber& apiVersion);
 QJsonObject makeEditPatientToken(const QVersionNumber& apiVersion, const QString& pid);
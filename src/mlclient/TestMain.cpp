@@ -1,20 +1,50 @@
 // Copyright 2023, Daniel Volk <mail@volkarts.com>
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include "HttpCassette.h"
+#include "HttpReplayTransport.h"
 #include "MlClient.h"
+#include "MlEmulator.h"
+#include "MlEmulatorTransport.h"
 #include "Tools.h"
+#include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QSslSocket>
 
 int main(int argc, char* argv[])
 {
     QCoreApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOptions({
+        {QStringLiteral("emulate"),
+         QStringLiteral("Run against an in-process Mainzelliste emulator with <patients> patients."),
+         QStringLiteral("patients")},
+        {QStringLiteral("count"),
+         QStringLiteral("Number of PIDs to load from the emulated dataset (default: 2)."),
+         QStringLiteral("count"), QStringLiteral("2")},
+        {QStringLiteral("record"),
+         QStringLiteral("Record all HTTP exchanges into cassette <file>."),
+         QStringLiteral("file")},
+        {QStringLiteral("replay"),
+         QStringLiteral("Answer requests from cassette <file> instead of the server."),
+         QStringLiteral("file")},
+        {QStringLiteral("replay-speed"),
+         QStringLiteral("Time scale of the replayed response durations, 0 replays instantly (default: 1)."),
+         QStringLiteral("factor"), QStringLiteral("1")},
+    });
+    parser.process(app);
+
     qCInfo(MLC_LOG_CAT) <<
         "TLS library built against:" << QSslSocket::sslLibraryBuildVersionString() << "\n" <<
         "TLS library version available:" << QSslSocket::sslLibraryVersionString();
 
+    QScopedPointer<MlEmulator> emulator;
+    HttpCassette cassette;
+
     MlClient client{
         QStringLiteral("http://localhost:8080/mainzelliste.muko"),
         QVersionNumber(2, 2),
@@ -24,19 +54,57 @@ int main(int argc, char* argv[])
     QStringList pids{QStringLiteral("ZPU3P1W3"), QStringLiteral("EL8F3DNC")};
     QStringList fields{QStringLiteral("vorname"), QStringLiteral("nachname")};
 
+    if (parser.isSet(QStringLiteral("emulate")))
+    {
+        emulator.reset(new MlEmulator{parser.value(QStringLiteral("emulate")).toLongLong()});
+        client.setTransport(new MlEmulatorTransport{emulator.get()});
+
+        const auto count = qMin(parser.value(QStringLiteral("count")).toLongLong(), emulator->patientCount());
+        pids.clear();
+        for (qint64 i = 0; i < count; ++i)
+        {
+            pids << emulator->pidAt(i);
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("replay")))
+    {
+        if (!cassette.load(parser.value(QStringLiteral("replay"))))
+        {
+            qCCritical(MLC_LOG_CAT) << "Failed to load cassette:" << cassette.errorString();
+            return 1;
+        }
+        client.setTransport(new HttpReplayTransport{
+                                &cassette, parser.value(QStringLiteral("replay-speed")).toDouble()});
+    }
+    else if (parser.isSet(QStringLiteral("record")))
+    {
+        if (!cassette.startRecording(parser.value(QStringLiteral("record"))))
+        {
+            qCCritical(MLC_LOG_CAT) << "Failed to create cassette:" << cassette.errorString();
+            return 1;
+        }
+        client.setRecorder(&cassette);
+    }
+
+    QElapsedTimer timer;
+
     QObject::connect(&client, &MlClient::patientDataLoadingDone, &client,
-                     [] (const MlClient::Error& error, const MlClient::PatientData& data) {
+                     [&timer, &pids] (const MlClient::Error& error, const MlClient::PatientData& data) {
         if (error)
         {
             qCInfo(MLC_LOG_CAT) << "ERROR:" << error.message;
         }
-        else
+        else if (data.size() <= 10)
         {
             qCInfo(MLC_LOG_CAT) << data;
         }
+        qCInfo(MLC_LOG_CAT) << "Loaded" << data.size() << "of" << pids.size() << "patients in" <<
+                               timer.elapsed() << "ms";
         QCoreApplication::quit();
     });
 
+    timer.start();
     client.loadPatientData(pids, fields);
 
     return QCoreApplication::exec();
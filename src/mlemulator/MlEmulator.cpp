@@ -0,0 +1,419 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlEmulator.h"
+
+#include "MlPidValidator.h"
+#include "Tools.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <array>
+
+namespace {
+
+// Alphabet of the Mainzelliste PID generator. 6 characters of 5 bit each give a 30 bit PID space, followed by 2 check
+// characters.
+constexpr char PidAlphabet[] = "0123456789ACDEFGHJKLMNPQRTUVWXYZ";
+constexpr int PidLength = 8;
+constexpr int PidValueLength = 6;
+constexpr quint64 PidMask = (quint64{1} << 30) - 1;
+
+// The index is scrambled with an odd multiplier so consecutive patients do not get similar PIDs
+constexpr quint64 PidMultiplier = 0x5DEECE66DULL;
+constexpr quint64 PidOffset = 0x2545F4914FULL;
+
+constexpr quint64 inverseMultiplier()
+{
+    quint64 inv = PidMultiplier;
+    for (int i = 0; i < 6; ++i)
+        inv *= 2 - PidMultiplier * inv;
+    return inv & PidMask;
+}
+
+constexpr std::array<qint8, 128> makePidDecodeTable()
+{
+    std::array<qint8, 128> table{};
+    for (auto& v : table)
+        v = -1;
+    for (int i = 0; i < 32; ++i)
+        table[static_cast<size_t>(PidAlphabet[i])] = static_cast<qint8>(i);
+    return table;
+}
+
+constexpr auto PidDecodeTable = makePidDecodeTable();
+
+quint64 mix(quint64 x)
+{
+    // splitmix64 finalizer
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+quint64 stableHash(const QString& string)
+{
+    // FNV-1a, stable across processes in contrast to qHash
+    quint64 h = 0xCBF29CE484222325ULL;
+    for (const auto c : string)
+    {
+        h ^= c.unicode();
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+template<size_t N>
+QString pick(const std::array<const char*, N>& values, quint64 h)
+{
+    return QString::fromUtf8(values[h % N]);
+}
+
+const std::array<const char*, 16> FirstNames{
+    "Anna", "Ben", "Clara", "David", "Emma", "Felix", "Greta", "Hannes",
+    "Ida", "Jonas", "Klara", "Lukas", "Marie", "Noah", "Olivia", "Paul",
+};
+
+const std::array<const char*, 16> LastNames{
+    "Müller", "Schmidt", "Schneider", "Fischer", "Weber", "Meyer", "Wagner", "Becker",
+    "Schulz", "Hoffmann", "Koch", "Richter", "Klein", "Wolf", "Neumann", "Schwarz",
+};
+
+const std::array<const char*, 8> Cities{
+    "Berlin", "Hamburg", "München", "Köln", "Frankfurt", "Stuttgart", "Leipzig", "Mainz",
+};
+
+MlEmulator::Response jsonResponse(int statusCode, const QJsonDocument& json)
+{
+    return {statusCode, QByteArrayLiteral("application/json"), json.toJson(QJsonDocument::Compact)};
+}
+
+MlEmulator::Response errorResponse(int statusCode, const QString& message)
+{
+    return {statusCode, QByteArrayLiteral("text/plain"), message.toUtf8()};
+}
+
+QJsonObject makeId(const QString& idType, const QString& idString)
+{
+    QJsonObject id;
+    id["idType"_l1] = idType;
+    id["idString"_l1] = idString;
+    return id;
+}
+
+} // namespace
+
+QStringList MlEmulator::defaultFields()
+{
+    return {
+        QStringLiteral("vorname"),
+        QStringLiteral("nachname"),
+        QStringLiteral("geburtsname"),
+        QStringLiteral("geburtstag"),
+        QStringLiteral("geburtsmonat"),
+        QStringLiteral("geburtsjahr"),
+        QStringLiteral("plz"),
+        QStringLiteral("ort"),
+    };
+}
+
+MlEmulator::MlEmulator(qint64 patientCount, QStringList fields, QString apiKey) :
+    patientCount_{patientCount},
+    fields_{std::move(fields)},
+    apiKey_{std::move(apiKey)}
+{
+    Q_ASSERT(patientCount_ >= 0 && static_cast<quint64>(patientCount_) <= PidMask);
+}
+
+QString MlEmulator::pidAt(qint64 index) const
+{
+    quint64 value = (static_cast<quint64>(index) * PidMultiplier + PidOffset) & PidMask;
+
+    QString pid(PidValueLength, Qt::Uninitialized);
+    for (int i = PidValueLength - 1; i >= 0; --i)
+    {
+        pid[i] = QLatin1Char(PidAlphabet[value & 31]);
+        value >>= 5;
+    }
+    return MlPidValidator::withCheckCharacters(pid);
+}
+
+qint64 MlEmulator::indexOf(const QString& pid) const
+{
+    // A PID with wrong check characters is never issued, so there is no such patient
+    if (!isWellFormedPid(pid) || !MlPidValidator::hasValidCheckCharacters(pid))
+        return -1;
+
+    quint64 value = 0;
+    for (const auto c : pid.first(PidValueLength))
+    {
+        value = (value << 5) | static_cast<quint64>(PidDecodeTable[c.unicode()]);
+    }
+
+    const auto index = ((value - PidOffset) * inverseMultiplier()) & PidMask;
+    if (index >= static_cast<quint64>(patientCount()))
+        return -1;
+    return static_cast<qint64>(index);
+}
+
+bool MlEmulator::isWellFormedPid(const QString& pid)
+{
+    if (pid.size() != PidLength)
+        return false;
+
+    for (const auto c : pid)
+    {
+        if (c.unicode() >= PidDecodeTable.size() || PidDecodeTable[c.unicode()] < 0)
+            return false;
+    }
+    return true;
+}
+
+MlEmulator::Response MlEmulator::handle(const Request& request)
+{
+    if (!apiKey_.isEmpty() && request.headers.value(QByteArrayLiteral("mainzellisteapikey")) != apiKey_.toUtf8())
+        return errorResponse(401, QStringLiteral("Please supply your API key in HTTP header field 'mainzellisteApiKey'."));
+
+    // Cut away the base path of the Mainzelliste instance
+    auto segments = request.path.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    while (!segments.isEmpty() && segments[0] != "sessions"_l1 && segments[0] != "patients"_l1)
+        segments.removeFirst();
+
+    const auto& method = request.method;
+
+    if (segments.size() == 1 && segments[0] == "sessions"_l1 && method == "POST")
+        return createSession();
+
+    if (segments.size() == 2 && segments[0] == "sessions"_l1 && method == "DELETE")
+        return deleteSession(segments[1]);
+
+    if (segments.size() == 3 && segments[0] == "sessions"_l1 && segments[2] == "tokens"_l1 && method == "POST")
+        return createToken(segments[1], request.body);
+
+    if (segments.size() == 1 && segments[0] == "patients"_l1 && method == "GET")
+        return readPatients(request.query.queryItemValue(QStringLiteral("tokenId")));
+
+    if (segments.size() == 1 && segments[0] == "patients"_l1 && method == "POST")
+        return addPatient(request.query.queryItemValue(QStringLiteral("tokenId")), request.body);
+
+    if (segments.size() == 3 && segments[0] == "patients"_l1 && segments[1] == "tokenId"_l1 && method == "PUT")
+        return editPatient(segments[2], request.body);
+
+    return errorResponse(404, QStringLiteral("Not found"));
+}
+
+MlEmulator::Response MlEmulator::createSession()
+{
+    const auto sessionId = nextId("s");
+    sessions_.insert(sessionId, {});
+
+    QJsonObject json;
+    json["sessionId"_l1] = sessionId;
+    json["uri"_l1] = "sessions/"_l1 + sessionId;
+    return jsonResponse(201, QJsonDocument{json});
+}
+
+MlEmulator::Response MlEmulator::deleteSession(const QString& sessionId)
+{
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end())
+        return errorResponse(404, QStringLiteral("No session with id %1").arg(sessionId));
+
+    for (const auto& tokenId : *it)
+        tokens_.remove(tokenId);
+    sessions_.erase(it);
+
+    return {204, {}, {}};
+}
+
+MlEmulator::Response MlEmulator::createToken(const QString& sessionId, const QByteArray& body)
+{
+    auto it = sessions_.find(sessionId);
+    if (it == sessions_.end())
+        return errorResponse(404, QStringLiteral("No session with id %1").arg(sessionId));
+
+    QJsonParseError parseError{};
+    const auto json = QJsonDocument::fromJson(body, &parseError).object();
+    if (parseError.error != QJsonParseError::NoError)
+        return errorResponse(400, QStringLiteral("Invalid token: %1").arg(parseError.errorString()));
+
+    Token token{sessionId, json["type"_l1].toString(), json["data"_l1].toObject()};
+    if (token.type != "readPatients"_l1 && token.type != "addPatient"_l1 && token.type != "editPatient"_l1)
+        return errorResponse(400, QStringLiteral("Token type %1 is not supported").arg(token.type));
+
+    if (token.type == "editPatient"_l1)
+    {
+        const auto pid = token.data["patientId"_l1].toObject()["idString"_l1].toString();
+        if (indexOf(pid) < 0)
+            return errorResponse(400, QStringLiteral("No patient found with ID %1").arg(pid));
+    }
+
+    const auto tokenId = nextId("t");
+    it->insert(tokenId);
+
+    QJsonObject result;
+    result["id"_l1] = tokenId;
+    result["type"_l1] = token.type;
+    result["data"_l1] = token.data;
+    result["uri"_l1] = "sessions/%1/tokens/%2"_l1.arg(sessionId, tokenId);
+
+    tokens_.insert(tokenId, std::move(token));
+
+    return jsonResponse(201, QJsonDocument{result});
+}
+
+MlEmulator::Response MlEmulator::readPatients(const QString& tokenId)
+{
+    bool ok{};
+    const auto token = takeToken(tokenId, QStringLiteral("readPatients"), &ok);
+    if (!ok)
+        return errorResponse(401, QStringLiteral("Please supply a valid 'readPatients' token."));
+
+    const auto searchIds = token.data["searchIds"_l1].toArray();
+    const auto resultIds = token.data["resultIds"_l1].toArray();
+    const auto resultFields = token.data["resultFields"_l1].toArray();
+
+    QJsonArray result;
+
+    for (const auto& searchId : searchIds)
+    {
+        const auto pid = searchId.toObject()["idString"_l1].toString();
+
+        if (!isWellFormedPid(pid))
+            return errorResponse(400, QStringLiteral("Invalid patient ID: %1").arg(pid));
+
+        const auto index = indexOf(pid);
+        if (index < 0)
+            continue;
+
+        QJsonArray ids;
+        for (const auto& idType : resultIds)
+        {
+            const auto type = idType.toString();
+            if (type == "pid"_l1)
+                ids << makeId(type, pid);
+            else
+                ids << makeId(type, QStringLiteral("%1-%2").arg(type, QString::number(index)));
+        }
+
+        QJsonObject fields;
+        for (const auto& field : resultFields)
+        {
+            const auto name = field.toString();
+            fields[name] = fieldValue(index, name);
+        }
+
+        QJsonObject patient;
+        patient["ids"_l1] = ids;
+        patient["fields"_l1] = fields;
+        result << patient;
+    }
+
+    return jsonResponse(200, QJsonDocument{result});
+}
+
+MlEmulator::Response MlEmulator::addPatient(const QString& tokenId, const QByteArray& body)
+{
+    bool ok{};
+    const auto token = takeToken(tokenId, QStringLiteral("addPatient"), &ok);
+    if (!ok)
+        return errorResponse(401, QStringLiteral("Please supply a valid 'addPatient' token."));
+
+    const QUrlQuery form{QString::fromUtf8(body)};
+
+    QHash<QString, QString> fields;
+    for (const auto& item : form.queryItems(QUrl::FullyDecoded))
+    {
+        if (fields_.contains(item.first))
+            fields.insert(item.first, item.second);
+    }
+
+    const auto index = patientCount();
+    ++addedCount_;
+    modifiedFields_.insert(index, fields);
+
+    QJsonObject id = makeId(QStringLiteral("pid"), pidAt(index));
+    id["tentative"_l1] = false;
+
+    return jsonResponse(201, QJsonDocument{QJsonArray{id}});
+}
+
+MlEmulator::Response MlEmulator::editPatient(const QString& tokenId, const QByteArray& body)
+{
+    bool ok{};
+    const auto token = takeToken(tokenId, QStringLiteral("editPatient"), &ok);
+    if (!ok)
+        return errorResponse(401, QStringLiteral("Please supply a valid 'editPatient' token."));
+
+    const auto index = indexOf(token.data["patientId"_l1].toObject()["idString"_l1].toString());
+    Q_ASSERT(index >= 0);
+
+    const auto json = QJsonDocument::fromJson(body).object();
+
+    auto& modified = modifiedFields_[index];
+    for (auto it = json.begin(); it != json.end(); ++it)
+    {
+        if (!fields_.contains(it.key()))
+            return errorResponse(400, QStringLiteral("Field %1 is not defined").arg(it.key()));
+        modified.insert(it.key(), it.value().toString());
+    }
+
+    return {204, {}, {}};
+}
+
+QString MlEmulator::fieldValue(qint64 index, const QString& field) const
+{
+    const auto modified = modifiedFields_.constFind(index);
+    if (modified != modifiedFields_.cend())
+    {
+        const auto value = modified->constFind(field);
+        if (value != modified->cend())
+            return *value;
+        if (index >= patientCount_)
+            return {};
+    }
+
+    const auto h = mix(static_cast<quint64>(index) ^ stableHash(field));
+
+    if (field == "vorname"_l1)
+        return pick(FirstNames, h);
+    if (field == "nachname"_l1 || field == "geburtsname"_l1)
+        return pick(LastNames, h);
+    if (field == "geburtstag"_l1)
+        return QString::number(1 + h % 28);
+    if (field == "geburtsmonat"_l1)
+        return QString::number(1 + h % 12);
+    if (field == "geburtsjahr"_l1)
+        return QString::number(1930 + h % 90);
+    if (field == "plz"_l1)
+        return QString::number(10000 + h % 90000);
+    if (field == "ort"_l1)
+        return pick(Cities, h);
+
+    return "%1-%2"_l1.arg(field, QString::number(h & 0xFFFFFF, 16));
+}
+
+MlEmulator::Token MlEmulator::takeToken(const QString& tokenId, const QString& type, bool* ok)
+{
+    auto it = tokens_.find(tokenId);
+    if (it == tokens_.end() || it->type != type)
+    {
+        *ok = false;
+        return {};
+    }
+
+    auto token = std::move(*it);
+    tokens_.erase(it);
+
+    auto session = sessions_.find(token.sessionId);
+    if (session != sessions_.end())
+        session->remove(tokenId);
+
+    *ok = true;
+    return token;
+}
+
+QString MlEmulator::nextId(const char* prefix)
+{
+    return QLatin1String{prefix} + QString::number(mix(idSource_++), 36);
+}
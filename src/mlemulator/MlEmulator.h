@@ -0,0 +1,78 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QSet>
+#include <QStringList>
+#include <QUrlQuery>
+
+// Emulates the parts of the Mainzelliste REST API used by MlClient: sessions, tokens, readPatients, addPatient and
+// editPatient. The patient dataset is synthetic and generated on the fly from the patient index, so millions of
+// patients cost no memory. Only added and edited patients are stored.
+class MlEmulator
+{
+public:
+    struct Request
+    {
+        QByteArray method{};
+        QString path{};
+        QUrlQuery query{};
+        QHash<QByteArray, QByteArray> headers{}; // header names in lower case
+        QByteArray body{};
+    };
+
+    struct Response
+    {
+        int statusCode{};
+        QByteArray contentType{};
+        QByteArray body{};
+    };
+
+    static QStringList defaultFields();
+
+public:
+    explicit MlEmulator(qint64 patientCount, QStringList fields = defaultFields(), QString apiKey = {});
+
+    qint64 patientCount() const { return patientCount_ + addedCount_; }
+    const QStringList& fields() const { return fields_; }
+
+    QString pidAt(qint64 index) const;
+    qint64 indexOf(const QString& pid) const;
+    static bool isWellFormedPid(const QString& pid);
+
+    Response handle(const Request& request);
+
+private:
+    struct Token
+    {
+        QString sessionId{};
+        QString type{};
+        QJsonObject data{};
+    };
+
+private:
+    Response createSession();
+    Response deleteSession(const QString& sessionId);
+    Response createToken(const QString& sessionId, const QByteArray& body);
+    Response readPatients(const QString& tokenId);
+    Response addPatient(const QString& tokenId, const QByteArray& body);
+    Response editPatient(const QString& tokenId, const QByteArray& body);
+
+    QString fieldValue(qint64 index, const QString& field) const;
+    Token takeToken(const QString& tokenId, const QString& type, bool* ok);
+    QString nextId(const char* prefix);
+
+private:
+    qint64 patientCount_;
+    QStringList fields_;
+    QString apiKey_;
+    qint64 addedCount_{};
+    QHash<qint64, QHash<QString, QString>> modifiedFields_{};
+    QHash<QString, QSet<QString>> sessions_{};
+    QHash<QString, Token> tokens_{};
+    quint64 idSource_{1};
+};
@@ -0,0 +1,73 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlEmulatorTransport.h"
+
+#include "HttpBody.h"
+#include "HttpCannedReply.h"
+
+namespace {
+
+QByteArray toVerb(HttpRequest::Method method)
+{
+    switch (method)
+    {
+        using enum HttpRequest::Method;
+
+        case GET:
+            return QByteArrayLiteral("GET");
+        case POST:
+            return QByteArrayLiteral("POST");
+        case PUT:
+            return QByteArrayLiteral("PUT");
+        case DELETE:
+            return QByteArrayLiteral("DELETE");
+    }
+
+    Q_UNREACHABLE();
+}
+
+} // namespace
+
+MlEmulatorTransport::MlEmulatorTransport(MlEmulator* emulator, QObject* parent) :
+    HttpTransport{parent},
+    emulator_{emulator}
+{
+}
+
+QNetworkReply* MlEmulatorTransport::send(HttpRequest::Method method, const QNetworkRequest& request,
+                                         const HttpBody& body)
+{
+    const auto response = emulator_->handle(makeEmulatorRequest(method, request, body));
+
+    auto reply = new HttpCannedReply{request, HttpCannedReply::operationFor(method), response.statusCode,
+                                     response.contentType, response.body, this};
+    reply->finishAfter(0);
+    return reply;
+}
+
+MlEmulator::Request MlEmulatorTransport::makeEmulatorRequest(HttpRequest::Method method,
+                                                             const QNetworkRequest& request, const HttpBody& body)
+{
+    MlEmulator::Request req;
+    req.method = toVerb(method);
+    req.path = request.url().path();
+    req.query = QUrlQuery{request.url()};
+
+    for (const auto& name : request.rawHeaderList())
+    {
+        req.headers.insert(name.toLower(), request.rawHeader(name));
+    }
+
+    if (body.isStreamed())
+    {
+        QScopedPointer<QIODevice> device{body.createDevice()};
+        req.body = device->readAll();
+    }
+    else
+    {
+        req.body = body.binaryData();
+    }
+
+    return req;
+}
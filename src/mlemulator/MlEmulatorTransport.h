@@ -0,0 +1,25 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "HttpTransport.h"
+#include "MlEmulator.h"
+
+// Serves requests in-process from an MlEmulator. Replies are delivered asynchronously through the event loop like
+// real network replies, but no socket is involved.
+class MlEmulatorTransport : public HttpTransport
+{
+    Q_OBJECT
+
+public:
+    MlEmulatorTransport(MlEmulator* emulator, QObject* parent = {});
+
+    QNetworkReply* send(HttpRequest::Method method, const QNetworkRequest& request, const HttpBody& body) override;
+
+    static MlEmulator::Request makeEmulatorRequest(HttpRequest::Method method, const QNetworkRequest& request,
+                                                   const HttpBody& body);
+
+private:
+    MlEmulator* emulator_;
+};
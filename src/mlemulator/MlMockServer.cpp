@@ -0,0 +1,260 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlMockServer.h"
+
+#include "Tools.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+
+namespace {
+
+constexpr qsizetype MaxHeaderSize = 64 * 1024;
+constexpr int BandwidthIntervalMs = 50;
+
+QByteArray reasonPhrase(int statusCode)
+{
+    switch (statusCode)
+    {
+        case 200: return QByteArrayLiteral("OK");
+        case 201: return QByteArrayLiteral("Created");
+        case 204: return QByteArrayLiteral("No Content");
+        case 400: return QByteArrayLiteral("Bad Request");
+        case 401: return QByteArrayLiteral("Unauthorized");
+        case 404: return QByteArrayLiteral("Not Found");
+        case 409: return QByteArrayLiteral("Conflict");
+        case 431: return QByteArrayLiteral("Request Header Fields Too Large");
+        case 500: return QByteArrayLiteral("Internal Server Error");
+        default: return QByteArrayLiteral("Unknown");
+    }
+}
+
+bool chance(double rate)
+{
+    return rate > 0.0 && QRandomGenerator::global()->generateDouble() < rate;
+}
+
+class MockConnection : public QObject
+{
+public:
+    MockConnection(QTcpSocket* socket, MlMockServer* server) :
+        QObject{socket},
+        socket_{socket},
+        server_{server}
+    {
+        connect(socket_, &QTcpSocket::readyRead, this, [this]() { onReadyRead(); });
+        connect(socket_, &QTcpSocket::disconnected, socket_, &QObject::deleteLater);
+    }
+
+private:
+    void onReadyRead()
+    {
+        inBuffer_.append(socket_->readAll());
+        processNext();
+    }
+
+    void processNext()
+    {
+        if (busy_)
+            return;
+
+        MlEmulator::Request request;
+        if (!parseRequest(request))
+            return;
+
+        busy_ = true;
+
+        // The request is processed at once so the dataset sees requests in arrival order, only the response is
+        // delayed
+        const auto response = server_->process(request);
+
+        QTimer::singleShot(server_->nextLatency(), this, [this, response]() { startResponse(response); });
+    }
+
+    bool parseRequest(MlEmulator::Request& request)
+    {
+        const auto headerEnd = inBuffer_.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+        {
+            if (inBuffer_.size() > MaxHeaderSize)
+            {
+                closeAfter_ = true;
+                busy_ = true;
+                startResponse({431, QByteArrayLiteral("text/plain"), QByteArrayLiteral("Header too large")});
+            }
+            return false;
+        }
+
+        const auto lines = inBuffer_.left(headerEnd).split('\n');
+        const auto requestLine = lines[0].trimmed().split(' ');
+        if (requestLine.size() < 3)
+        {
+            closeAfter_ = true;
+            busy_ = true;
+            startResponse({400, QByteArrayLiteral("text/plain"), QByteArrayLiteral("Malformed request line")});
+            return false;
+        }
+
+        for (qsizetype i = 1; i < lines.size(); ++i)
+        {
+            const auto colon = lines[i].indexOf(':');
+            if (colon <= 0)
+                continue;
+            request.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+        }
+
+        const auto contentLength = request.headers.value(QByteArrayLiteral("content-length")).toLongLong();
+        const auto requestSize = headerEnd + 4 + contentLength;
+        if (inBuffer_.size() < requestSize)
+            return false;
+
+        const auto target = QUrl::fromEncoded(requestLine[1]);
+
+        request.method = requestLine[0];
+        request.path = target.path();
+        request.query = QUrlQuery{target};
+        request.body = inBuffer_.mid(headerEnd + 4, contentLength);
+
+        inBuffer_.remove(0, requestSize);
+
+        if (request.headers.value(QByteArrayLiteral("connection")).toLower() == "close" ||
+                requestLine[2] == "HTTP/1.0")
+            closeAfter_ = true;
+
+        return true;
+    }
+
+    void startResponse(const MlEmulator::Response& response)
+    {
+        QByteArray head = "HTTP/1.1 " + QByteArray::number(response.statusCode) + ' ' +
+                reasonPhrase(response.statusCode) + "\r\n";
+        if (!response.contentType.isEmpty())
+            head += "Content-Type: " + response.contentType + "\r\n";
+        head += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+        head += closeAfter_ ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+        head += "\r\n";
+
+        outBuffer_ = head + response.body;
+        outPos_ = 0;
+        stallAt_ = server_->nextStall() ? head.size() + response.body.size() / 2 : -1;
+
+        writeSome();
+    }
+
+    void writeSome()
+    {
+        const auto bandwidth = server_->faults().bandwidth;
+
+        qint64 end = outBuffer_.size();
+        if (bandwidth > 0)
+            end = qMin(end, outPos_ + qMax(qint64{1}, bandwidth * BandwidthIntervalMs / 1000));
+        if (stallAt_ >= 0)
+            end = qMin(end, stallAt_);
+
+        socket_->write(outBuffer_.constData() + outPos_, end - outPos_);
+        outPos_ = end;
+
+        if (outPos_ == stallAt_)
+        {
+            // slowloris style: the connection stays open but no data arrives for a while
+            stallAt_ = -1;
+            QTimer::singleShot(server_->faults().stallMs, this, [this]() { writeSome(); });
+            return;
+        }
+
+        if (outPos_ < outBuffer_.size())
+        {
+            QTimer::singleShot(BandwidthIntervalMs, this, [this]() { writeSome(); });
+            return;
+        }
+
+        outBuffer_.clear();
+        busy_ = false;
+
+        if (closeAfter_)
+        {
+            socket_->disconnectFromHost();
+            return;
+        }
+
+        processNext();
+    }
+
+private:
+    QTcpSocket* socket_;
+    MlMockServer* server_;
+    QByteArray inBuffer_{};
+    QByteArray outBuffer_{};
+    qint64 outPos_{};
+    qint64 stallAt_{-1};
+    bool busy_{};
+    bool closeAfter_{};
+};
+
+} // namespace
+
+MlMockServer::MlMockServer(MlEmulator* emulator, const Faults& faults, QObject* parent) :
+    QObject{parent},
+    emulator_{emulator},
+    faults_{faults}
+{
+    connect(&server_, &QTcpServer::newConnection, this, &MlMockServer::onNewConnection);
+}
+
+bool MlMockServer::listen(const QHostAddress& address, quint16 port)
+{
+    return server_.listen(address, port);
+}
+
+MlEmulator::Response MlMockServer::process(const MlEmulator::Request& request)
+{
+    if (chance(faults_.errorRate))
+        return {500, QByteArrayLiteral("text/plain"), QByteArrayLiteral("Injected server error")};
+
+    const bool addPatient = request.method == "POST" && request.path.endsWith("/patients"_l1);
+    if (addPatient && !request.body.contains("sureness=true") && chance(faults_.conflictRate))
+    {
+        QJsonArray possibleMatches;
+        const auto count = QRandomGenerator::global()->bounded(1, 4);
+        for (int i = 0; i < count; ++i)
+        {
+            const auto index = QRandomGenerator::global()->bounded(qMax(emulator_->patientCount(), qint64{1}));
+
+            QJsonObject match;
+            match["idType"_l1] = "pid"_l1;
+            match["idString"_l1] = emulator_->pidAt(index);
+            possibleMatches << match;
+        }
+
+        QJsonObject json;
+        json["message"_l1] = "Unsure case"_l1;
+        json["possibleMatches"_l1] = possibleMatches;
+        return {409, QByteArrayLiteral("application/json"), QJsonDocument{json}.toJson(QJsonDocument::Compact)};
+    }
+
+    return emulator_->handle(request);
+}
+
+int MlMockServer::nextLatency() const
+{
+    if (faults_.jitterMs <= 0)
+        return faults_.latencyMs;
+    return faults_.latencyMs + QRandomGenerator::global()->bounded(faults_.jitterMs + 1);
+}
+
+bool MlMockServer::nextStall() const
+{
+    return chance(faults_.stallRate);
+}
+
+void MlMockServer::onNewConnection()
+{
+    while (auto socket = server_.nextPendingConnection())
+    {
+        new MockConnection{socket, this};
+    }
+}
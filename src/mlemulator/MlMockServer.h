@@ -0,0 +1,47 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include "MlEmulator.h"
+#include <QHostAddress>
+#include <QObject>
+#include <QTcpServer>
+
+// Minimal HTTP/1.1 server in front of an MlEmulator with configurable latency, bandwidth and fault injection
+class MlMockServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Faults
+    {
+        int latencyMs{};
+        int jitterMs{};
+        qint64 bandwidth{};     // bytes per second and connection, 0 is unlimited
+        double errorRate{};     // share of requests answered with 500
+        double conflictRate{};  // share of addPatient requests answered with 409 and possible matches
+        double stallRate{};     // share of responses stalling in the middle of the body
+        int stallMs{};
+    };
+
+public:
+    MlMockServer(MlEmulator* emulator, const Faults& faults, QObject* parent = {});
+
+    bool listen(const QHostAddress& address, quint16 port);
+    QString errorString() const { return server_.errorString(); }
+
+    const Faults& faults() const { return faults_; }
+
+    MlEmulator::Response process(const MlEmulator::Request& request);
+    int nextLatency() const;
+    bool nextStall() const;
+
+private slots:
+    void onNewConnection();
+
+private:
+    MlEmulator* emulator_;
+    Faults faults_;
+    QTcpServer server_;
+};
@@ -0,0 +1,73 @@
+// Copyright 2023, Daniel Volk <mail@volkarts.com>
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "MlEmulator.h"
+#include "MlMockServer.h"
+#include "Tools.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("mlserver_mock"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Mainzelliste stand-in serving a synthetic dataset"));
+    parser.addHelpOption();
+    parser.addOptions({
+        {QStringLiteral("port"), QStringLiteral("TCP port to listen on."),
+         QStringLiteral("port"), QStringLiteral("8080")},
+        {QStringLiteral("patients"), QStringLiteral("Number of synthetic patients."),
+         QStringLiteral("count"), QStringLiteral("1000000")},
+        {QStringLiteral("fields"), QStringLiteral("Comma separated list of patient fields."),
+         QStringLiteral("fields"), MlEmulator::defaultFields().join(QLatin1Char(','))},
+        {QStringLiteral("api-key"), QStringLiteral("Required API key, empty accepts any."),
+         QStringLiteral("key")},
+        {QStringLiteral("latency"), QStringLiteral("Latency added to every response."),
+         QStringLiteral("ms"), QStringLiteral("0")},
+        {QStringLiteral("jitter"), QStringLiteral("Random additional latency up to this value."),
+         QStringLiteral("ms"), QStringLiteral("0")},
+        {QStringLiteral("bandwidth"), QStringLiteral("Bandwidth cap per connection, 0 is unlimited."),
+         QStringLiteral("bytes/s"), QStringLiteral("0")},
+        {QStringLiteral("error-rate"), QStringLiteral("Share of requests failing with 500."),
+         QStringLiteral("0..1"), QStringLiteral("0")},
+        {QStringLiteral("conflict-rate"), QStringLiteral("Share of addPatient requests answered with 409."),
+         QStringLiteral("0..1"), QStringLiteral("0")},
+        {QStringLiteral("stall-rate"), QStringLiteral("Share of responses stalling in the middle of the body."),
+         QStringLiteral("0..1"), QStringLiteral("0")},
+        {QStringLiteral("stall"), QStringLiteral("Duration of a stall."),
+         QStringLiteral("ms"), QStringLiteral("30000")},
+    });
+    parser.process(app);
+
+    MlEmulator emulator{
+        parser.value(QStringLiteral("patients")).toLongLong(),
+        parser.value(QStringLiteral("fields")).split(QLatin1Char(','), Qt::SkipEmptyParts),
+        parser.value(QStringLiteral("api-key")),
+    };
+
+    MlMockServer::Faults faults;
+    faults.latencyMs = parser.value(QStringLiteral("latency")).toInt();
+    faults.jitterMs = parser.value(QStringLiteral("jitter")).toInt();
+    faults.bandwidth = parser.value(QStringLiteral("bandwidth")).toLongLong();
+    faults.errorRate = parser.value(QStringLiteral("error-rate")).toDouble();
+    faults.conflictRate = parser.value(QStringLiteral("conflict-rate")).toDouble();
+    faults.stallRate = parser.value(QStringLiteral("stall-rate")).toDouble();
+    faults.stallMs = parser.value(QStringLiteral("stall")).toInt();
+
+    MlMockServer server{&emulator, faults};
+
+    const auto port = parser.value(QStringLiteral("port")).toUShort();
+    if (!server.listen(QHostAddress::Any, port))
+    {
+        qCCritical(MLC_LOG_CAT) << "Failed to listen on port" << port << ":" << server.errorString();
+        return 1;
+    }
+
+    qCInfo(MLC_LOG_CAT).noquote() << "Serving" << emulator.patientCount() << "patients on port" << port <<
+                                     "- first PID:" << emulator.pidAt(0);
+
+    return QCoreApplication::exec();
+}